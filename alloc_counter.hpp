@@ -0,0 +1,103 @@
+/*
+High-Performance C++: Heap allocation counter for the timestep loop
+Purpose: Verify that the steady-state timestep makes no heap allocations (transient buffers come from step_arena.hpp).
+         The same operator new is the tracked allocator of memory_report.hpp: each block carries a 16-byte header with
+         its size and the subsystem it is charged to, so bytes per subsystem can be reported.
+Notes: This header REPLACES the global operator new/delete, so it must be included by exactly one translation unit
+       of a program (every engine here is a single .cpp file). Only the two base forms are replaced; the array,
+       nothrow and sized forms of the standard library forward to them.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <ostream>
+#include "memory_report.hpp"
+
+inline std::atomic<std::uint64_t> g_heap_allocations{0};
+
+inline std::uint64_t heap_allocations() { return g_heap_allocations.load(std::memory_order_relaxed); }
+
+// Header in front of every block: the requested size and the subsystem it was charged to (memory_report.hpp).
+struct alignas(16) AllocHeader {
+    std::size_t bytes;
+    int tag;
+};
+
+// Records n bytes in the header just below base + offset and returns that address.
+inline void* charge_block(void* base, std::size_t offset, std::size_t n) {
+    char* p = static_cast<char*>(base) + offset;
+    AllocHeader* header = reinterpret_cast<AllocHeader*>(p) - 1;
+    header->bytes = n;
+    header->tag = memory_tag();
+    memory_charge(header->tag, static_cast<std::int64_t>(n));
+    return p;
+}
+
+// Credits the block at p and returns the address malloc handed out (offset bytes below p).
+inline void* release_block(void* p, std::size_t offset) {
+    const AllocHeader* header = reinterpret_cast<AllocHeader*>(p) - 1;
+    memory_charge(header->tag, -static_cast<std::int64_t>(header->bytes));
+    return static_cast<char*>(p) - offset;
+}
+
+inline std::size_t header_offset(std::align_val_t align) {
+    return static_cast<std::size_t>(align) > sizeof(AllocHeader) ? static_cast<std::size_t>(align)
+                                                                  : sizeof(AllocHeader);
+}
+
+void* operator new(std::size_t n) {
+    g_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n + sizeof(AllocHeader))) return charge_block(p, sizeof(AllocHeader), n);
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t n, std::align_val_t align) {
+    g_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    const std::size_t a = header_offset(align);
+    if (void* p = std::aligned_alloc(a, (n + a + a - 1) / a * a)) return charge_block(p, a, n);
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    if (p) std::free(release_block(p, sizeof(AllocHeader)));
+}
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+void operator delete(void* p, std::align_val_t align) noexcept {
+    if (p) std::free(release_block(p, header_offset(align)));
+}
+void operator delete(void* p, std::size_t, std::align_val_t align) noexcept { operator delete(p, align); }
+
+// Heap allocations per timestep: the first step may warm up (stream buffers, thread teams), later ones must not.
+class StepAllocStats {
+public:
+    void begin_step() { start_ = heap_allocations(); }
+    void end_step() {
+        const std::uint64_t n = heap_allocations() - start_;
+        if (steps_++ == 0) {
+            first_ = n;
+        } else {
+            steady_total_ += n;
+            if (n > steady_max_) steady_max_ = n;
+        }
+    }
+    std::uint64_t steady_max() const { return steady_max_; }
+
+    // A warning, not a failure: the run is still correct, it only paid for heap traffic in the loop.
+    void warn_steady(std::ostream& out, const char* unit = "step") const {
+        if (steady_max_ == 0) return;
+        out << "[alloc] warning: " << steady_total_ << " heap allocations in steady-state " << unit << "s (at most "
+            << steady_max_ << " per " << unit << ")\n";
+    }
+
+    void report(std::ostream& out, const char* unit = "step") const {
+        out << "[alloc] " << unit << "_count=" << steps_ << " first_" << unit << "=" << first_
+            << " steady_total=" << steady_total_ << " steady_max_per_" << unit << "=" << steady_max_ << "\n";
+    }
+
+private:
+    std::uint64_t start_ = 0, first_ = 0, steady_total_ = 0, steady_max_ = 0, steps_ = 0;
+};
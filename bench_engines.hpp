@@ -0,0 +1,58 @@
+/*
+High-Performance C++: The engine executables, for the tools that drive them
+Purpose: One list of engines (name on the command line, executable, whether it takes --threads) shared by the
+         benchmark harness and the cross-engine verifier, plus the small helpers both need to start them.
+Notes: Engines are started with popen from the working directory; on Windows through _popen and ".\".
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+static const char* const kExePrefix = ".\\";
+#else
+static const char* const kExePrefix = "./";
+#endif
+
+struct Engine {
+    const char* name;
+    const char* exe;
+    bool threaded; // takes --threads=N; the others run once per shape with threads = 1
+};
+
+static const Engine kEngines[] = {
+    {"serial", "serial_baseline.exe", false},
+    {"optimized", "cache_optimized.exe", false},
+    {"inplace", "inplace_rolling.exe", false},
+    {"out_of_core", "out_of_core.exe", false},
+    {"compressed", "compressed_grid.exe", false},
+    {"threads", "parallel_threads.exe", true},
+    {"openmp", "parallel_openmp.exe", true},
+};
+
+inline const Engine* find_engine(const std::string& name) {
+    for (const Engine& e : kEngines) {
+        if (name == e.name) return &e;
+    }
+    return nullptr;
+}
+
+inline std::vector<std::string> split_list(const std::string& text, char sep) {
+    std::vector<std::string> items;
+    std::size_t begin = 0;
+    while (begin <= text.size()) {
+        const std::size_t end = std::min(text.find(sep, begin), text.size());
+        if (end > begin) items.push_back(text.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return items;
+}
+
+inline bool file_exists(const std::string& path) { return std::ifstream(path).good(); }
@@ -0,0 +1,825 @@
+/*
+High-Performance C++: Benchmark driver for all engines
+Purpose: Time every engine over a matrix of grid shapes and thread counts with the same protocol, and keep the numbers
+         in machine-readable form instead of copying single runs into the README by hand.
+Key ideas: Each engine runs as its own process (`./<engine>.exe nx ny nt [--threads=T] --quiet`), so every trial
+           starts cold, exactly like a user would run it; the time is the engine's own `[chrono] time_us` line, which
+           covers the timestep loop only: every engine starts its clock after allocating and initialising the grid.
+           A few warm-up runs (page cache, CPU frequency) are discarded, then the trials are reduced to median, mean
+           and a 95% confidence interval (bench_stats.hpp). Results go to stdout as a table and optionally to JSON
+           and CSV.
+           Each result is also normalised against the host: the modelled traffic of the run (roofline.hpp) over the
+           median time, as a fraction of the calibrated triad bandwidth (stream_probe.hpp) of the cache level the
+           grid fits in at that thread count. The calibration is cached per host and measured on first use;
+           --calibrate re-measures it and exits. The fraction is a lower bound: the loop time also holds the output
+           phase and per-step bookkeeping, which move none of the modelled bytes, and the model counts each element
+           once per pass, so traffic lost to cache misses only adds to what the run really moved.
+           --scaling=strong|weak runs a scaling study instead of a plain matrix: each shape at every thread count as
+           is (strong) or with nx multiplied by the thread count (weak; the parallel engines split rows), followed by
+           the speedup over the engine's own one-thread run, the parallel efficiency and the Karp-Flatt serial
+           fraction e = (1/S - 1/p) / (1 - 1/p). Weak scaling uses the scaled speedup p * T1 / Tp. Single-thread
+           engines run at the same shapes, so each parallel row is also compared with them (vs_<engine>). Rows with
+           more threads than the host has hardware threads are marked oversubscribed: their e measures time slicing.
+           --baseline=PATH is a regression gate: each result is compared with the same configuration in a baseline
+           JSON written by this harness (a file, or the file for this host class in a directory of baselines) using
+           the one-sided Mann-Whitney U test on the trial times (bench_stats.hpp). A configuration regresses when
+           its median is slower by more than --threshold percent and the test rejects "no slowdown" at --alpha; the
+           harness then exits with status 2. --record-baseline writes the run as the new baseline instead.
+           --sweep[=MIN:MAX] looks for the cache cliffs: instead of --shapes it runs grids ny (--sweep-ny) cells wide
+           whose working set, modelled as vi + vr over the padded row, grows geometrically (--sweep-steps points per
+           octave) from a quarter of L1 to four times the LLC, with nt chosen for a constant number of cell updates.
+           Per engine it tabulates ns per cell update (of the update phase when the engine prints "[phases]"), with
+           a bar, the cache level of each size, the plateau of each level and the steepest rise around each boundary.
+           Sweep runs pin --transpose=off --nt-stores=off --pad=auto (unless --flags sets them), so the storage
+           layout stays the same across the range.
+Notes: Engines write data_out into the working directory, so runs are strictly sequential. serial_baseline.exe takes
+       only --dump-grid after nx ny nt and ignores every other flag, so --flags and the sweep's pinned flags do not
+       reach it. Engines whose executable has not been built are skipped with a note.
+*/
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "bench_engines.hpp"
+#include "bench_stats.hpp"
+#include "machine_probe.hpp"
+#include "roofline.hpp"
+#include "stencil_options.hpp"
+#include "stream_probe.hpp"
+
+using namespace std;
+
+struct Shape {
+    long long nx, ny;
+    int nt;
+};
+
+struct BenchConfig {
+    const Engine* engine;
+    long long nx, ny;
+    int nt, threads;
+};
+
+struct BenchResult {
+    BenchConfig cfg;
+    vector<double> samples_ms;
+    SampleStats stats;
+    string error; // empty on success
+    int stream_level = kLevelDRAM;
+    double model_gbps = 0.0, stream_gbps = 0.0; // modelled traffic / median time, calibrated roof
+    long peak_rss_kb = -1;                       // largest "[memory] peak_rss_kb" of the trials, -1 if not printed
+    vector<double> update_ms;                    // "[phases] update_ms" of every trial, for engines that print it
+};
+
+enum class Scaling { None, Strong, Weak };
+
+// One row of a scaling study: a threaded engine at p threads against its own one-thread run.
+struct ScalingRow {
+    const BenchResult* result;
+    int base_threads;     // usually 1: the smallest thread count measured
+    double speedup = 0.0; // strong: T1 / Tp, weak: p * T1 / Tp (both relative to base_threads)
+    double efficiency = 0.0;
+    double karp_flatt = 0.0; // experimentally determined serial fraction, undefined (0) at p = base_threads
+    const BenchResult* reference = nullptr; // a single-thread engine at the same shape, when one ran
+};
+
+// What one trial printed besides its time (-1 where the engine does not report it).
+struct TrialExtras {
+    long peak_rss_kb = -1;   // memory_report.hpp
+    double update_ms = -1.0; // interior update phase alone, from the "[phases]" line
+};
+
+// Runs one trial; returns false (with a reason) if the engine failed or printed no time.
+static bool run_once(const BenchConfig& cfg, const string& extra_flags, double& ms, TrialExtras& extras,
+                     string& error) {
+    string cmd = string(kExePrefix) + cfg.engine->exe + " " + to_string(cfg.nx) + " " + to_string(cfg.ny) + " " +
+                 to_string(cfg.nt) + " --quiet";
+    if (cfg.engine->threaded) cmd += " --threads=" + to_string(cfg.threads);
+    if (!extra_flags.empty()) cmd += " " + extra_flags;
+    cmd += " 2>&1";
+    FILE* pipe = popen(cmd.c_str(), "r");
+    if (!pipe) {
+        error = "cannot start " + cmd;
+        return false;
+    }
+    double time_us = -1.0, time_ms = -1.0;
+    string line;
+    char chunk[4096];
+    while (fgets(chunk, sizeof(chunk), pipe)) {
+        line += chunk;
+        if (line.empty() || line.back() != '\n') continue; // long line, keep reading
+        if (line.compare(0, 17, "[chrono] time_us=") == 0) time_us = atof(line.c_str() + 17);
+        else if (line.compare(0, 17, "[chrono] time_ms=") == 0) time_ms = atof(line.c_str() + 17);
+        else if (line.compare(0, 21, "[memory] peak_rss_kb=") == 0) extras.peak_rss_kb = atol(line.c_str() + 21);
+        else if (line.compare(0, 9, "[phases] ") == 0 && line.find(" update_ms=") != string::npos) {
+            extras.update_ms = atof(line.c_str() + line.find(" update_ms=") + 11);
+        }
+        line.clear();
+    }
+    const int status = pclose(pipe);
+    if (status != 0) {
+        error = "exit status " + to_string(status);
+        return false;
+    }
+    if (time_us >= 0.0) ms = time_us * 1e-3;
+    else if (time_ms >= 0.0) ms = time_ms;
+    else {
+        error = "no [chrono] line";
+        return false;
+    }
+    return true;
+}
+
+static string format_interval(double lo, double hi) {
+    ostringstream out;
+    out << fixed << setprecision(2) << "[" << lo << ", " << hi << "]";
+    return out.str();
+}
+
+// Warm-up and trials of one configuration, normalised against the stream calibration; prints one table row.
+static BenchResult run_config(const BenchConfig& cfg, const string& extra_flags, int warmup, int trials,
+                              const StreamTable& stream, const CacheSizes& caches) {
+    BenchResult res;
+    res.cfg = cfg;
+    double ms = 0.0;
+    TrialExtras extras;
+    for (int w = 0; w < warmup && res.error.empty(); ++w) run_once(cfg, extra_flags, ms, extras, res.error);
+    for (int k = 0; k < trials && res.error.empty(); ++k) {
+        extras = TrialExtras();
+        if (!run_once(cfg, extra_flags, ms, extras, res.error)) break;
+        res.samples_ms.push_back(ms);
+        res.peak_rss_kb = max(res.peak_rss_kb, extras.peak_rss_kb);
+        if (extras.update_ms >= 0.0) res.update_ms.push_back(extras.update_ms);
+    }
+    const string shape_text = to_string(cfg.nx) + "x" + to_string(cfg.ny) + "x" + to_string(cfg.nt);
+    cout << left << setw(12) << cfg.engine->name << right << setw(18) << shape_text << setw(8) << cfg.threads;
+    if (res.error.empty()) {
+        res.stats = summarize(res.samples_ms);
+        const SampleStats& s = res.stats;
+        double bytes = 0.0;
+        for (Phase phase : {kPhaseUpdate, kPhaseBoundaries, kPhaseScan, kPhaseAverage}) {
+            bytes += phase_cost(phase, cfg.nx, cfg.ny, cfg.nt, true).bytes;
+        }
+        const size_t working_set = 2 * sizeof(double) * static_cast<size_t>(cfg.nx * cfg.ny);
+        res.stream_level = stream_level_for(working_set, cfg.threads, caches);
+        const StreamRow* roof = stream.find(res.stream_level, cfg.threads);
+        res.model_gbps = bytes / max(s.median * 1e-3, 1e-12) * 1e-9;
+        res.stream_gbps = roof ? roof->traffic_gbps() : 0.0;
+        cout << setw(12) << s.median << setw(12) << s.mean << setw(24) << format_interval(s.ci95_lo, s.ci95_hi)
+             << setw(12) << s.min << setw(9) << res.model_gbps << setw(11)
+             << (res.stream_gbps > 0.0 ? res.model_gbps / res.stream_gbps : 0.0) << setw(12);
+        if (res.peak_rss_kb >= 0) cout << res.peak_rss_kb / 1024.0 << "\n";
+        else cout << "-" << "\n";
+    } else {
+        cout << "  FAILED: " << res.error << "\n";
+    }
+    cout.flush();
+    return res;
+}
+
+// Scaling rows of every threaded engine and base shape, in run order. Results sharing a group id (index of the base
+// shape) belong to one study; the weak study multiplies nx by the thread count, the strong one keeps the shape.
+static vector<ScalingRow> scaling_rows(Scaling mode, const vector<BenchResult>& results, const vector<int>& group) {
+    vector<ScalingRow> rows;
+    for (size_t r = 0; r < results.size(); ++r) {
+        const BenchResult& res = results[r];
+        if (!res.cfg.engine->threaded || !res.error.empty()) continue;
+        const BenchResult* base = nullptr;
+        for (size_t b = 0; b < results.size(); ++b) {
+            const BenchResult& cand = results[b];
+            if (group[b] != group[r] || cand.cfg.engine != res.cfg.engine || !cand.error.empty()) continue;
+            if (!base || cand.cfg.threads < base->cfg.threads) base = &cand;
+        }
+        ScalingRow row{&res, base->cfg.threads};
+        const double p = static_cast<double>(res.cfg.threads) / base->cfg.threads;
+        const double ratio = base->stats.median / max(res.stats.median, 1e-12);
+        row.speedup = mode == Scaling::Weak ? p * ratio : ratio;
+        row.efficiency = row.speedup / p;
+        if (p > 1.0) row.karp_flatt = (1.0 / row.speedup - 1.0 / p) / (1.0 - 1.0 / p);
+        for (size_t b = 0; b < results.size(); ++b) {
+            const BenchResult& cand = results[b];
+            if (group[b] == group[r] && !cand.cfg.engine->threaded && cand.error.empty() && cand.cfg.nx == res.cfg.nx &&
+                cand.cfg.ny == res.cfg.ny) {
+                row.reference = &cand;
+            }
+        }
+        rows.push_back(row);
+    }
+    return rows;
+}
+
+static void report_scaling(Scaling mode, const vector<ScalingRow>& rows, const string& csv_path,
+                           const HostInfo& host) {
+    const char* mode_name = mode == Scaling::Weak ? "weak" : "strong";
+    cout << "[scaling] mode=" << mode_name << "\n";
+    cout << left << setw(12) << "engine" << right << setw(18) << "shape" << setw(8) << "threads" << setw(12)
+         << "median_ms" << setw(10) << "speedup" << setw(12) << "efficiency" << setw(12) << "karp_flatt"
+         << "  reference\n";
+    ofstream csv;
+    if (!csv_path.empty()) {
+        csv.open(csv_path);
+        csv << setprecision(6) << fixed;
+        csv << "host,mode,engine,nx,ny,nt,threads,base_threads,median_ms,speedup,efficiency,karp_flatt,"
+               "reference_engine,reference_median_ms,vs_reference\n";
+    }
+    for (const ScalingRow& row : rows) {
+        const BenchConfig& cfg = row.result->cfg;
+        const double median = row.result->stats.median;
+        const string shape_text = to_string(cfg.nx) + "x" + to_string(cfg.ny) + "x" + to_string(cfg.nt);
+        cout << left << setw(12) << cfg.engine->name << right << setw(18) << shape_text << setw(8) << cfg.threads
+             << setw(12) << median << setw(10) << row.speedup << setw(12) << row.efficiency << setw(12);
+        if (cfg.threads > row.base_threads) cout << row.karp_flatt;
+        else cout << "-";
+        // > 1: the parallel engine beats the single-thread one on the same grid
+        const double vs = row.reference ? row.reference->stats.median / max(median, 1e-12) : 0.0;
+        if (row.reference) cout << "  vs_" << row.reference->cfg.engine->name << "=" << vs;
+        // more threads than hardware threads: time slicing, not a serial part, drives the speedup and e
+        if (host.threads > 0 && static_cast<unsigned>(cfg.threads) > host.threads) cout << "  oversubscribed";
+        cout << "\n";
+        if (csv.is_open()) {
+            csv << host.name << "," << mode_name << "," << cfg.engine->name << "," << cfg.nx << "," << cfg.ny << ","
+                << cfg.nt << "," << cfg.threads << "," << row.base_threads << "," << median << "," << row.speedup
+                << "," << row.efficiency << "," << row.karp_flatt << ","
+                << (row.reference ? row.reference->cfg.engine->name : "") << ","
+                << (row.reference ? row.reference->stats.median : 0.0) << "," << vs << "\n";
+        }
+    }
+    if (csv.is_open()) cout << "[scaling] wrote " << csv_path << "\n";
+}
+
+// Cache-cliff sweep: grids of a fixed width whose working set (vi + vr over the padded row stride) grows geometrically.
+constexpr double kSweepCellUpdates = 1e8; // nt is chosen so every run does about this many cell updates,
+constexpr double kSweepMaxSteps = 10000;  // but no more steps than this, where fixed per-step costs would dominate
+constexpr double kCliffPct = 15.0;        // a point at least this much slower per cell than the previous one
+
+// Layout flags pinned for every sweep run unless --flags sets them: the engines' automatic transposition (nx >= 8 ny)
+// and streaming stores (fields beyond the LLC) would otherwise switch layout in the middle of the range, and a cliff
+// there could not be told from the change. The row padding is pinned so the stride below is the one the engines use.
+static string sweep_flags(const string& extra_flags, int& pad_lines) {
+    string flags = extra_flags;
+    for (const char* pinned : {"--transpose=off", "--nt-stores=off", "--pad=auto"}) {
+        const string name(pinned, strchr(pinned, '=') + 1);
+        if (flags.find(name) == string::npos) flags += (flags.empty() ? "" : " ") + string(pinned);
+    }
+    const size_t at = flags.find("--pad=") + 6;
+    const string pad = flags.substr(at, flags.find(' ', at) - at);
+    pad_lines = pad == "auto" ? -1 : pad == "off" ? -2 : atoi(pad.c_str());
+    return flags;
+}
+
+// Bytes of vi + vr for an nx x ny grid; the engines pad every row of ny doubles to `stride`.
+static double sweep_bytes(long long nx, size_t stride) { return 2.0 * sizeof(double) * nx * stride; }
+
+static vector<Shape> sweep_shapes(size_t min_bytes, size_t max_bytes, int per_octave, long long ny, size_t stride) {
+    vector<Shape> shapes;
+    const double bytes_per_row = sweep_bytes(1, stride);
+    const int points = static_cast<int>(ceil(log2(static_cast<double>(max_bytes) / min_bytes) * per_octave));
+    for (int k = 0; k <= points; ++k) {
+        const double bytes = min_bytes * pow(2.0, static_cast<double>(k) / per_octave);
+        const long long nx = max(3LL, llround(bytes / bytes_per_row));
+        if (!shapes.empty() && shapes.back().nx == nx) continue;
+        const double nt = kSweepCellUpdates / (static_cast<double>(nx) * ny);
+        shapes.push_back({nx, ny, static_cast<int>(min(kSweepMaxSteps, max(3.0, round(nt))))});
+    }
+    return shapes;
+}
+
+// Per engine: ns per cell update at every size (the update phase alone when the engine reports it, else the whole
+// run), the step to the previous size, and the plateau of each cache level and the steepest rise around each
+// boundary (between half and four times its size, where associativity and replacement smear the cliff).
+static void report_sweep(const vector<BenchResult>& results, const CacheSizes& caches, size_t stride,
+                         const string& csv_path, const HostInfo& host) {
+    ofstream csv;
+    if (!csv_path.empty()) {
+        csv.open(csv_path);
+        csv << setprecision(6) << fixed;
+        csv << "host,engine,threads,nx,ny,nt,working_set_bytes,level,ns_per_cell,metric,rise_pct\n";
+    }
+    struct Point {
+        const BenchResult* result;
+        double bytes, ns;
+        int level;
+    };
+    vector<const Engine*> seen;
+    for (const BenchResult& first : results) {
+        const Engine* engine = first.cfg.engine;
+        if (find(seen.begin(), seen.end(), engine) != seen.end()) continue;
+        seen.push_back(engine);
+        vector<Point> points;
+        bool update_only = true;
+        for (const BenchResult& res : results) {
+            if (res.cfg.engine == engine && res.error.empty()) update_only = update_only && !res.update_ms.empty();
+        }
+        for (const BenchResult& res : results) {
+            if (res.cfg.engine != engine || !res.error.empty()) continue;
+            const double cells = static_cast<double>(res.cfg.nx) * res.cfg.ny * max(1, res.cfg.nt);
+            const double ms = update_only ? summarize(res.update_ms).median : res.stats.median;
+            const double bytes = sweep_bytes(res.cfg.nx, stride);
+            points.push_back({&res, bytes, ms * 1e6 / cells,
+                              stream_level_for(static_cast<size_t>(bytes), res.cfg.threads, caches)});
+        }
+        if (points.empty()) continue;
+        double slowest = 0.0;
+        for (const Point& p : points) slowest = max(slowest, p.ns);
+
+        const char* metric = update_only ? "update" : "run";
+        cout << "[sweep] engine=" << engine->name << " threads=" << points[0].result->cfg.threads
+             << " metric=" << metric << " (ns per cell update" << (update_only ? ", update phase" : ", whole run")
+             << ")\n";
+        cout << setw(14) << "working_set" << setw(7) << "level" << setw(10) << "nx" << setw(8) << "nt" << setw(12)
+             << "ns_per_cell" << setw(9) << "rise%" << "\n";
+        for (size_t k = 0; k < points.size(); ++k) {
+            const Point& p = points[k];
+            const double rise = k ? 100.0 * (p.ns / max(points[k - 1].ns, 1e-12) - 1.0) : 0.0;
+            const string size_text = p.bytes >= 1 << 20 ? to_string(llround(p.bytes / (1 << 20))) + "M"
+                                                         : to_string(llround(p.bytes / 1024)) + "K";
+            cout << setw(14) << size_text << setw(7) << stream_level_name(p.level) << setw(10) << p.result->cfg.nx
+                 << setw(8) << p.result->cfg.nt << setw(12) << setprecision(3) << p.ns << setw(9) << setprecision(1)
+                 << rise << "  " << string(static_cast<size_t>(40.0 * p.ns / max(slowest, 1e-12) + 0.5), '#');
+            if (k && rise >= kCliffPct) cout << "  <- cliff";
+            cout << "\n" << setprecision(2);
+            if (csv.is_open()) {
+                csv << host.name << "," << engine->name << "," << p.result->cfg.threads << "," << p.result->cfg.nx
+                    << "," << p.result->cfg.ny << "," << p.result->cfg.nt << "," << llround(p.bytes) << ","
+                    << stream_level_name(p.level) << "," << p.ns << "," << metric << "," << rise << "\n";
+            }
+        }
+
+        // plateaus: median ns per cell of the sizes inside each level
+        cout << "[sweep] engine=" << engine->name << " plateau_ns_per_cell";
+        double first_plateau = 0.0;
+        for (int level = 0; level < kLevelCount; ++level) {
+            vector<double> ns;
+            for (const Point& p : points) {
+                if (p.level == level) ns.push_back(p.ns);
+            }
+            if (ns.empty()) continue;
+            const double plateau = summarize(ns).median;
+            if (first_plateau == 0.0) first_plateau = plateau;
+            cout << " " << stream_level_name(level) << "=" << setprecision(3) << plateau << " (x" << setprecision(2)
+                 << plateau / first_plateau << ")";
+        }
+        cout << "\n";
+        const size_t bounds[] = {caches.l1d, caches.l2, caches.llc};
+        const char* const names[] = {"L1->L2", "L2->LLC", "LLC->DRAM"};
+        for (int b = 0; b < 3; ++b) {
+            int best = -1;
+            double best_ratio = 0.0;
+            for (size_t k = 1; k < points.size(); ++k) {
+                if (points[k].bytes < bounds[b] / 2.0 || points[k - 1].bytes > bounds[b] * 4.0) continue;
+                const double ratio = points[k].ns / max(points[k - 1].ns, 1e-12);
+                if (best < 0 || ratio > best_ratio) {
+                    best = static_cast<int>(k);
+                    best_ratio = ratio;
+                }
+            }
+            if (best < 0) continue;
+            cout << "[sweep] engine=" << engine->name << " boundary=" << names[b] << " (" << bounds[b] / 1024 << "K)";
+            if (best_ratio <= 1.0) {
+                cout << " no_rise\n";
+                continue;
+            }
+            cout << " steepest_rise=" << setprecision(1) << 100.0 * (best_ratio - 1.0) << "% between "
+                 << llround(points[best - 1].bytes / 1024) << "K and " << llround(points[best].bytes / 1024) << "K ("
+                 << setprecision(3) << points[best - 1].ns << " -> " << points[best].ns << " ns/cell)\n"
+                 << setprecision(2);
+        }
+    }
+    if (csv.is_open()) cout << "[sweep] wrote " << csv_path << "\n";
+}
+
+// Hardware the timings are comparable across: CPU model and hardware threads, as a file-name-safe slug.
+static string host_class(const HostInfo& host) {
+    string slug;
+    for (char c : host.cpu) {
+        const bool keep = isalnum(static_cast<unsigned char>(c)) != 0;
+        if (keep) slug += static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        else if (!slug.empty() && slug.back() != '_') slug += '_';
+    }
+    while (!slug.empty() && slug.back() == '_') slug.pop_back();
+    return (slug.empty() ? string("unknown") : slug) + "_" + to_string(host.threads) + "t";
+}
+
+// A path ending in .json is the baseline itself, anything else a directory of <host class>.json files.
+static string baseline_file(const string& path, const HostInfo& host) {
+    if (path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0) return path;
+    return path + (path.empty() || path.back() == '/' ? "" : "/") + host_class(host) + ".json";
+}
+
+struct BaselineEntry {
+    string engine;
+    long long nx = 0, ny = 0;
+    int nt = 0, threads = 0;
+    vector<double> samples_ms;
+};
+
+// Raw text of "key": value in one JSON object of write_json's output (strings keep their quotes).
+static string json_field(const string& object, const string& key) {
+    const size_t at = object.find("\"" + key + "\": ");
+    if (at == string::npos) return "";
+    size_t begin = at + key.size() + 4, end = begin;
+    if (object[begin] == '"') end = object.find('"', begin + 1) + 1;
+    else if (object[begin] == '[') end = object.find(']', begin) + 1;
+    else end = object.find_first_of(",}", begin);
+    return end == string::npos ? "" : object.substr(begin, end - begin);
+}
+
+static string json_unquote(const string& text) {
+    return text.size() >= 2 && text.front() == '"' ? text.substr(1, text.size() - 2) : text;
+}
+
+// Version of what time_us measures. Baselines of another version are refused: version 1 (no field) still had the
+// ~10 ms TSC calibration inside the timed loop of the engines with a latency histogram.
+constexpr int kTimingProtocol = 2;
+
+// Reads a baseline written by write_json (one result object per line); false if the file is missing or malformed.
+
+static bool load_baseline(const string& path, string& host_class_name, string& extra_flags, int& protocol,
+                          vector<BaselineEntry>& entries) {
+    ifstream in(path);
+    if (!in) return false;
+    string line;
+    protocol = 1;
+    while (getline(in, line)) {
+        if (line.find("\"timing_protocol\": ") != string::npos) {
+            protocol = atoi(json_field(line, "timing_protocol").c_str());
+        }
+        if (line.find("\"host\": ") != string::npos) host_class_name = json_unquote(json_field(line, "host_class"));
+        if (line.find("\"extra_flags\": ") != string::npos) extra_flags = json_unquote(json_field(line, "extra_flags"));
+        if (line.find("\"engine\": ") == string::npos || line.find("\"samples_ms\": ") == string::npos) continue;
+        BaselineEntry entry;
+        entry.engine = json_unquote(json_field(line, "engine"));
+        entry.nx = atoll(json_field(line, "nx").c_str());
+        entry.ny = atoll(json_field(line, "ny").c_str());
+        entry.nt = atoi(json_field(line, "nt").c_str());
+        entry.threads = atoi(json_field(line, "threads").c_str());
+        const string samples = json_field(line, "samples_ms");
+        for (const string& value : split_list(samples.substr(1, samples.size() - 2), ',')) {
+            entry.samples_ms.push_back(atof(value.c_str()));
+        }
+        if (!entry.samples_ms.empty()) entries.push_back(entry);
+    }
+    return !entries.empty();
+}
+
+// Prints one verdict per result with a baseline; returns the number of regressions.
+static int gate_against_baseline(const vector<BenchResult>& results, const vector<BaselineEntry>& baseline,
+                                 double threshold_pct, double alpha) {
+    int regressions = 0;
+    cout << "[gate] threshold=" << threshold_pct << "% alpha=" << alpha << "\n";
+    cout << left << setw(12) << "engine" << right << setw(18) << "shape" << setw(8) << "threads" << setw(12)
+         << "base_ms" << setw(12) << "median_ms" << setw(10) << "change%" << setw(10) << "p_slower"
+         << setw(10) << "p_faster" << "  verdict\n";
+    for (const BenchResult& res : results) {
+        if (!res.error.empty()) continue;
+        const BenchConfig& cfg = res.cfg;
+        const BaselineEntry* base = nullptr;
+        for (const BaselineEntry& entry : baseline) {
+            if (entry.engine == cfg.engine->name && entry.nx == cfg.nx && entry.ny == cfg.ny && entry.nt == cfg.nt &&
+                entry.threads == cfg.threads) {
+                base = &entry;
+            }
+        }
+        const string shape_text = to_string(cfg.nx) + "x" + to_string(cfg.ny) + "x" + to_string(cfg.nt);
+        cout << left << setw(12) << cfg.engine->name << right << setw(18) << shape_text << setw(8) << cfg.threads;
+        if (!base) {
+            cout << "  not in baseline\n";
+            continue;
+        }
+        const double base_median = summarize(base->samples_ms).median;
+        const double change = 100.0 * (res.stats.median / max(base_median, 1e-12) - 1.0);
+        const double p_slower = mann_whitney_greater(base->samples_ms, res.samples_ms);
+        const double p_faster = mann_whitney_greater(res.samples_ms, base->samples_ms);
+        const char* verdict = "same";
+        if (change > threshold_pct && p_slower <= alpha) {
+            verdict = "REGRESSION";
+            ++regressions;
+        } else if (change < -threshold_pct && p_faster <= alpha) {
+            verdict = "faster";
+        } else if (fabs(change) > threshold_pct) {
+            verdict = "inconclusive"; // beyond the threshold but within the noise of these trials
+        }
+        cout << setw(12) << base_median << setw(12) << res.stats.median << setw(10) << change << setprecision(4)
+             << setw(10) << p_slower << setw(10) << p_faster << setprecision(2) << "  " << verdict << "\n";
+    }
+    return regressions;
+}
+
+static string json_string(const string& text) {
+    string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) out += c;
+    }
+    return out + "\"";
+}
+
+static void write_json(const string& path, const HostInfo& host, const string& timestamp, int warmup, int trials,
+                       const string& extra_flags, const vector<BenchResult>& results) {
+    ofstream out(path);
+    out << setprecision(6) << fixed;
+    out << "{\n  \"host\": {\"name\": " << json_string(host.name) << ", \"cpu\": " << json_string(host.cpu)
+        << ", \"hardware_threads\": " << host.threads << ", \"host_class\": " << json_string(host_class(host))
+        << "},\n";
+    out << "  \"timestamp\": " << json_string(timestamp) << ", \"timing_protocol\": " << kTimingProtocol << ",\n";
+    out << "  \"warmup\": " << warmup << ", \"trials\": " << trials << ", \"extra_flags\": " << json_string(extra_flags)
+        << ",\n  \"results\": [";
+    for (size_t r = 0; r < results.size(); ++r) {
+        const BenchResult& res = results[r];
+        const SampleStats& s = res.stats;
+        out << (r ? ",\n" : "\n") << "    {\"engine\": " << json_string(res.cfg.engine->name)
+            << ", \"nx\": " << res.cfg.nx << ", \"ny\": " << res.cfg.ny << ", \"nt\": " << res.cfg.nt
+            << ", \"threads\": " << res.cfg.threads;
+        if (!res.error.empty()) {
+            out << ", \"error\": " << json_string(res.error) << "}";
+            continue;
+        }
+        out << ", \"samples_ms\": [";
+        for (size_t k = 0; k < res.samples_ms.size(); ++k) out << (k ? ", " : "") << res.samples_ms[k];
+        out << "], \"median_ms\": " << s.median << ", \"mean_ms\": " << s.mean << ", \"stddev_ms\": " << s.stddev
+            << ", \"min_ms\": " << s.min << ", \"max_ms\": " << s.max << ", \"ci95_lo_ms\": " << s.ci95_lo
+            << ", \"ci95_hi_ms\": " << s.ci95_hi << ", \"model_GBps\": " << res.model_gbps
+            << ", \"stream_level\": " << json_string(stream_level_name(res.stream_level))
+            << ", \"stream_GBps\": " << res.stream_gbps
+            << ", \"fraction_of_stream\": " << (res.stream_gbps > 0.0 ? res.model_gbps / res.stream_gbps : 0.0)
+            << ", \"peak_rss_kb\": " << res.peak_rss_kb << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static void write_csv(const string& path, const HostInfo& host, const vector<BenchResult>& results) {
+    ofstream out(path);
+    out << setprecision(6) << fixed;
+    out << "host,engine,nx,ny,nt,threads,trials,median_ms,mean_ms,stddev_ms,min_ms,max_ms,ci95_lo_ms,ci95_hi_ms,"
+           "model_GBps,stream_level,stream_GBps,fraction_of_stream,peak_rss_kb,error\n";
+    for (const BenchResult& res : results) {
+        const SampleStats& s = res.stats;
+        out << host.name << "," << res.cfg.engine->name << "," << res.cfg.nx << "," << res.cfg.ny << "," << res.cfg.nt
+            << "," << res.cfg.threads << "," << s.n << "," << s.median << "," << s.mean << "," << s.stddev << ","
+            << s.min << "," << s.max << "," << s.ci95_lo << "," << s.ci95_hi << "," << res.model_gbps << ","
+            << stream_level_name(res.stream_level) << "," << res.stream_gbps << ","
+            << (res.stream_gbps > 0.0 ? res.model_gbps / res.stream_gbps : 0.0) << "," << res.peak_rss_kb << ","
+            << res.error << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // CLI: [--engines=serial,optimized,threads,openmp] [--shapes=NXxNYxNT,...] [--threads=1,2,4] [--warmup=1]
+    //      [--trials=5] [--flags="--prefetch=2 ..."] [--json=path] [--csv=path] [--calibrate]
+    //      [--scaling=strong|weak] [--scaling-csv=path] [--baseline=file.json|dir] [--record-baseline]
+    //      [--threshold=5] [--alpha=0.05] [--sweep | --sweep=MIN:MAX] [--sweep-steps=4] [--sweep-ny=128]
+    //      [--sweep-csv=path]
+    string engines_arg = "serial,optimized,threads,openmp", shapes_arg = "10000x200x200", threads_arg;
+    string extra_flags, json_path, csv_path, scaling_csv;
+    Scaling scaling = Scaling::None;
+    string baseline_arg;
+    bool record_baseline = false;
+    double threshold_pct = 5.0, alpha = 0.05;
+    int warmup = 1, trials = 5;
+    bool calibrate = false;
+    bool sweep = false;
+    string sweep_range, sweep_csv;
+    int sweep_steps = 4;
+    long long sweep_ny = 128;
+    size_t sweep_stride = 0;
+    for (int a = 1; a < argc; ++a) {
+        const char* arg = argv[a];
+        const char* v = nullptr;
+        if ((v = stencil_flag_value(arg, "engines"))) engines_arg = v;
+        else if ((v = stencil_flag_value(arg, "shapes"))) shapes_arg = v;
+        else if ((v = stencil_flag_value(arg, "threads"))) threads_arg = v;
+        else if ((v = stencil_flag_value(arg, "warmup"))) warmup = atoi(v);
+        else if ((v = stencil_flag_value(arg, "trials"))) trials = atoi(v);
+        else if ((v = stencil_flag_value(arg, "flags"))) extra_flags = v;
+        else if ((v = stencil_flag_value(arg, "json"))) json_path = v;
+        else if ((v = stencil_flag_value(arg, "csv"))) csv_path = v;
+        else if ((v = stencil_flag_value(arg, "scaling-csv"))) scaling_csv = v;
+        else if ((v = stencil_flag_value(arg, "scaling"))) {
+            if (strcmp(v, "strong") == 0) scaling = Scaling::Strong;
+            else if (strcmp(v, "weak") == 0) scaling = Scaling::Weak;
+            else {
+                cerr << "--scaling must be strong or weak.\n";
+                return 1;
+            }
+        }
+        else if ((v = stencil_flag_value(arg, "baseline"))) baseline_arg = v;
+        else if ((v = stencil_flag_value(arg, "threshold"))) threshold_pct = atof(v);
+        else if ((v = stencil_flag_value(arg, "alpha"))) alpha = atof(v);
+        else if (strcmp(arg, "--record-baseline") == 0) record_baseline = true;
+        else if (strcmp(arg, "--calibrate") == 0) calibrate = true;
+        else if ((v = stencil_flag_value(arg, "sweep-steps"))) sweep_steps = atoi(v);
+        else if ((v = stencil_flag_value(arg, "sweep-ny"))) sweep_ny = atoll(v);
+        else if ((v = stencil_flag_value(arg, "sweep-csv"))) sweep_csv = v;
+        else if ((v = stencil_flag_value(arg, "sweep"))) {
+            sweep = true;
+            sweep_range = v;
+        }
+        else if (strcmp(arg, "--sweep") == 0) sweep = true;
+        else {
+            cerr << "Unknown argument: " << arg << "\n";
+            return 1;
+        }
+    }
+    if (warmup < 0 || trials < 1) {
+        cerr << "--warmup must be >= 0 and --trials >= 1.\n";
+        return 1;
+    }
+    if (threshold_pct < 0.0 || alpha <= 0.0 || alpha >= 1.0) {
+        cerr << "--threshold must be >= 0 and --alpha in (0, 1).\n";
+        return 1;
+    }
+    if (record_baseline && baseline_arg.empty()) {
+        cerr << "--record-baseline needs --baseline=PATH.\n";
+        return 1;
+    }
+    if (sweep && (scaling != Scaling::None || sweep_steps < 1 || sweep_ny < 3)) {
+        cerr << "--sweep cannot be combined with --scaling; --sweep-steps must be >= 1 and --sweep-ny >= 3.\n";
+        return 1;
+    }
+
+    vector<const Engine*> engines;
+    for (const string& name : split_list(engines_arg, ',')) {
+        const Engine* found = find_engine(name);
+        if (!found) {
+            cerr << "Unknown engine: " << name << " (expected serial, optimized, inplace, out_of_core, compressed, "
+                 << "threads or openmp)\n";
+            return 1;
+        }
+        if (!file_exists(found->exe)) {
+            cout << "[bench] skipping " << found->name << ": " << found->exe << " not built\n";
+            continue;
+        }
+        engines.push_back(found);
+    }
+    vector<Shape> shapes;
+    for (const string& text : split_list(shapes_arg, ',')) {
+        const vector<string> dims = split_list(text, 'x');
+        Shape shape{0, 0, 0};
+        if (dims.size() == 3) shape = {atoll(dims[0].c_str()), atoll(dims[1].c_str()), atoi(dims[2].c_str())};
+        if (shape.nx < 1 || shape.ny < 1 || shape.nt < 0) {
+            cerr << "Bad shape: " << text << " (expected NXxNYxNT)\n";
+            return 1;
+        }
+        shapes.push_back(shape);
+    }
+    const HostInfo host = describe_host();
+    const CacheSizes caches = detect_cache_sizes();
+    const CpuTopology topo = detect_topology();
+
+    // a cache-cliff sweep replaces --shapes: from a quarter of L1 to four times the LLC (at most 1 GiB) by default
+    if (sweep) {
+        size_t min_bytes = caches.l1d / 4, max_bytes = min(size_t(1) << 30, 4 * caches.llc);
+        if (!sweep_range.empty()) {
+            const vector<string> range = split_list(sweep_range, ':');
+            min_bytes = range.size() == 2 ? parse_cache_size(range[0]) : 0;
+            max_bytes = range.size() == 2 ? parse_cache_size(range[1]) : 0;
+        }
+        if (min_bytes == 0 || max_bytes <= min_bytes) {
+            cerr << "Bad sweep range: " << sweep_range << " (expected MIN:MAX such as 8K:256M)\n";
+            return 1;
+        }
+        int pad_lines = -1;
+        extra_flags = sweep_flags(extra_flags, pad_lines);
+        sweep_stride = padded_stride(static_cast<int>(sweep_ny), pad_lines);
+        shapes = sweep_shapes(min_bytes, max_bytes, sweep_steps, sweep_ny, sweep_stride);
+        cout << "[sweep] " << shapes.size() << " sizes from " << min_bytes / 1024 << "K to " << max_bytes / 1024
+             << "K, ny=" << sweep_ny << " (stride " << sweep_stride << "), about " << kSweepCellUpdates
+             << " cell updates each, flags \"" << extra_flags << "\"\n";
+    }
+
+    // a scaling study without --threads doubles from 1 up to the logical CPUs (which are always included)
+    if (threads_arg.empty() && scaling != Scaling::None) {
+        const int logical = max(1, topo.logical);
+        for (int threads = 1; threads < logical; threads *= 2) threads_arg += to_string(threads) + ",";
+        threads_arg += to_string(logical);
+    }
+    if (threads_arg.empty()) threads_arg = "1";
+    vector<int> thread_counts;
+    for (const string& text : split_list(threads_arg, ',')) {
+        const int threads = atoi(text.c_str());
+        if (threads < 1) {
+            cerr << "Bad thread count: " << text << "\n";
+            return 1;
+        }
+        thread_counts.push_back(threads);
+    }
+    if (thread_counts.empty()) thread_counts.push_back(1);
+    sort(thread_counts.begin(), thread_counts.end());
+    thread_counts.erase(unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+    if (sweep && thread_counts.size() > 1) {
+        cerr << "--sweep runs the threaded engines at one thread count.\n";
+        return 1;
+    }
+    cout << "[bench] caches l1d=" << caches.l1d << " l2=" << caches.l2 << " llc=" << caches.llc << " ("
+         << caches.source << ") topology logical=" << topo.logical << " cores=" << topo.cores
+         << " packages=" << topo.packages << " (" << topo.source << ")\n";
+
+    // calibration: 1 thread, every requested count and all hardware threads; reused while the host is unchanged
+    const string signature = stream_signature(host, caches, topo), stream_path = stream_cache_path(host);
+    vector<int> calib_threads = {1};
+    for (int threads : thread_counts) calib_threads.push_back(threads);
+    calib_threads.push_back(max(1, topo.logical));
+    sort(calib_threads.begin(), calib_threads.end());
+    calib_threads.erase(unique(calib_threads.begin(), calib_threads.end()), calib_threads.end());
+    StreamTable stream;
+    bool complete = !calibrate && load_stream_table(stream_path, signature, stream);
+    for (int threads : calib_threads) complete = complete && stream.find(kLevelDRAM, threads);
+    if (complete) {
+        cout << "[bench] stream calibration from " << stream_path << "\n";
+    } else {
+        cout << "[bench] measuring stream calibration (" << stream_path << ")\n";
+        stream = measure_stream_table(signature, caches, calib_threads, cout);
+        if (!save_stream_table(stream_path, stream)) cout << "[bench] could not write " << stream_path << "\n";
+    }
+    if (calibrate) return 0;
+
+    // the baseline is read up front so a missing or foreign one is reported before the (long) run
+    string baseline_path, baseline_class, baseline_flags;
+    int baseline_protocol = 0;
+    vector<BaselineEntry> baseline;
+    if (!baseline_arg.empty()) {
+        baseline_path = baseline_file(baseline_arg, host);
+        if (record_baseline) {
+            cout << "[gate] recording baseline " << baseline_path << " (host class " << host_class(host) << ")\n";
+        } else if (!load_baseline(baseline_path, baseline_class, baseline_flags, baseline_protocol, baseline)) {
+            cerr << "No baseline at " << baseline_path << " (host class " << host_class(host)
+                 << "); record one with --record-baseline.\n";
+            return 1;
+        } else if (baseline_class != host_class(host)) {
+            cerr << "Baseline " << baseline_path << " is for host class " << baseline_class << ", this host is "
+                 << host_class(host) << ".\n";
+            return 1;
+        } else if (baseline_protocol != kTimingProtocol) {
+            cerr << "Baseline " << baseline_path << " was timed with protocol " << baseline_protocol << ", this harness"
+                 << " uses " << kTimingProtocol << "; re-record it with --record-baseline.\n";
+            return 1;
+        } else {
+            cout << "[gate] baseline " << baseline_path << " (" << baseline.size() << " configurations)\n";
+            if (baseline_flags != extra_flags) {
+                cout << "[gate] note: baseline ran with --flags=\"" << baseline_flags << "\", this run with \""
+                     << extra_flags << "\"\n";
+            }
+        }
+    }
+
+    char timestamp[32];
+    const time_t now = time(nullptr);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    cout << "[bench] host=" << host.name << " cpu=\"" << host.cpu << "\" hardware_threads=" << host.threads
+         << " warmup=" << warmup << " trials=" << trials << "\n";
+    cout << left << setw(12) << "engine" << right << setw(18) << "shape" << setw(8) << "threads" << setw(12)
+         << "median_ms" << setw(12) << "mean_ms" << setw(24) << "ci95_ms" << setw(12) << "min_ms" << setw(9)
+         << "GB/s" << setw(11) << "of_stream" << setw(12) << "peak_rss_MB" << "\n";
+    cout << fixed << setprecision(2);
+
+    // plain matrix: every shape x engine x thread count (single-thread engines once per shape); weak scaling grows
+    // nx with the thread count and runs the single-thread engines at every grown shape
+    vector<BenchResult> results;
+    vector<int> group; // index of the base shape of each result
+    for (size_t g = 0; g < shapes.size(); ++g) {
+        const Shape& shape = shapes[g];
+        for (const Engine* engine : engines) {
+            for (size_t t = 0; t < thread_counts.size(); ++t) {
+                const bool grow = scaling == Scaling::Weak;
+                if (!engine->threaded && t > 0 && !grow) break;
+                const long long nx = grow ? shape.nx * thread_counts[t] : shape.nx;
+                const BenchConfig cfg{engine, nx, shape.ny, shape.nt, engine->threaded ? thread_counts[t] : 1};
+                results.push_back(run_config(cfg, extra_flags, warmup, trials, stream, caches));
+                group.push_back(static_cast<int>(g));
+            }
+        }
+    }
+    if (scaling != Scaling::None) report_scaling(scaling, scaling_rows(scaling, results, group), scaling_csv, host);
+    if (sweep) report_sweep(results, caches, sweep_stride, sweep_csv, host);
+
+    if (!json_path.empty()) {
+        write_json(json_path, host, timestamp, warmup, trials, extra_flags, results);
+        cout << "[bench] wrote " << json_path << "\n";
+    }
+    if (!csv_path.empty()) {
+        write_csv(csv_path, host, results);
+        cout << "[bench] wrote " << csv_path << "\n";
+    }
+    if (record_baseline) {
+        write_json(baseline_path, host, timestamp, warmup, trials, extra_flags, results);
+        cout << "[gate] wrote " << baseline_path << "\n";
+    }
+    const int regressions = baseline.empty() ? 0 : gate_against_baseline(results, baseline, threshold_pct, alpha);
+    for (const BenchResult& res : results) {
+        if (!res.error.empty()) return 1;
+    }
+    if (regressions > 0) {
+        cout << "[gate] " << regressions << " configuration(s) regressed\n";
+        return 2;
+    }
+    return 0;
+}
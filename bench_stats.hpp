@@ -0,0 +1,114 @@
+/*
+High-Performance C++: Summary statistics for repeated benchmark trials
+Purpose: Reduce the wall times of the trials of one benchmark configuration to numbers that can be compared across
+         runs: the median (robust against the odd slow trial) and a 95% confidence interval of the mean.
+         Two runs of the same configuration are compared with the Mann-Whitney U test, which needs no assumption about
+         the shape of the distribution (trial times are skewed: a few slow outliers, never fast ones).
+Notes: The interval uses Student's t, which is right for the handful of trials a benchmark affords; it assumes roughly
+       normal trial times, so the median is the headline number and the interval says how far to trust it.
+       The U test is exact (full permutation distribution) for small samples without ties and uses the normal
+       approximation with tie and continuity correction otherwise. With 5 trials against 5 the smallest possible
+       one-sided p-value is 1/252, with 3 against 3 only 1/20.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+struct SampleStats {
+    int n = 0;
+    double min = 0.0, max = 0.0, median = 0.0, mean = 0.0, stddev = 0.0;
+    double ci95_lo = 0.0, ci95_hi = 0.0; // of the mean
+};
+
+// Two-sided 95% quantile of Student's t with df degrees of freedom.
+inline double student_t95(int df) {
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df < 1) return 0.0;
+    if (df <= 30) return table[df - 1];
+    return df <= 60 ? 2.000 : df <= 120 ? 1.980 : 1.960;
+}
+
+inline SampleStats summarize(std::vector<double> samples) {
+    SampleStats s;
+    s.n = static_cast<int>(samples.size());
+    if (s.n == 0) return s;
+    std::sort(samples.begin(), samples.end());
+    s.min = samples.front();
+    s.max = samples.back();
+    s.median = s.n % 2 ? samples[s.n / 2] : 0.5 * (samples[s.n / 2 - 1] + samples[s.n / 2]);
+    for (double x : samples) s.mean += x;
+    s.mean /= s.n;
+    if (s.n > 1) {
+        double ss = 0.0;
+        for (double x : samples) ss += (x - s.mean) * (x - s.mean);
+        s.stddev = std::sqrt(ss / (s.n - 1));
+    }
+    const double half_width = student_t95(s.n - 1) * s.stddev / std::sqrt(static_cast<double>(s.n));
+    s.ci95_lo = s.mean - half_width;
+    s.ci95_hi = s.mean + half_width;
+    return s;
+}
+
+// One-sided Mann-Whitney p-value for "b tends to be larger than a" (e.g. b slower than a baseline a).
+inline double mann_whitney_greater(const std::vector<double>& a, const std::vector<double>& b) {
+    const std::size_t n1 = a.size(), n2 = b.size();
+    if (n1 == 0 || n2 == 0) return 1.0;
+    // U = pairs with b above a, ties count half
+    double u = 0.0;
+    bool ties = false;
+    for (double x : a) {
+        for (double y : b) {
+            if (y > x) u += 1.0;
+            else if (y == x) {
+                u += 0.5;
+                ties = true;
+            }
+        }
+    }
+    const std::size_t max_u = n1 * n2;
+    if (!ties && max_u <= 2500) {
+        // count[m][v]: orderings of m values of a and j values of b with statistic v, for j = 0, 1, ..., n2.
+        // The largest value is either from b (above all m values of a) or from a (above none of b).
+        std::vector<std::vector<double>> count(n1 + 1, std::vector<double>(max_u + 1, 0.0)), prev;
+        for (std::size_t m = 0; m <= n1; ++m) count[m][0] = 1.0;
+        for (std::size_t j = 1; j <= n2; ++j) {
+            prev.swap(count);
+            count.assign(n1 + 1, std::vector<double>(max_u + 1, 0.0));
+            for (std::size_t m = 0; m <= n1; ++m) {
+                for (std::size_t v = 0; v <= max_u; ++v) {
+                    if (v >= m) count[m][v] += prev[m][v - m];
+                    if (m > 0) count[m][v] += count[m - 1][v];
+                }
+            }
+        }
+        double total = 0.0, tail = 0.0;
+        for (std::size_t v = 0; v <= max_u; ++v) {
+            total += count[n1][v];
+            if (static_cast<double>(v) >= u) tail += count[n1][v];
+        }
+        return tail / total;
+    }
+    // normal approximation: variance corrected for ties via the ranks of the pooled sample
+    std::vector<double> pooled(a);
+    pooled.insert(pooled.end(), b.begin(), b.end());
+    std::sort(pooled.begin(), pooled.end());
+    double tie_term = 0.0;
+    for (std::size_t i = 0; i < pooled.size();) {
+        std::size_t j = i;
+        while (j < pooled.size() && pooled[j] == pooled[i]) ++j;
+        const double t = static_cast<double>(j - i);
+        tie_term += t * t * t - t;
+        i = j;
+    }
+    const double n = static_cast<double>(n1 + n2);
+    const double mean = 0.5 * n1 * n2;
+    const double var = n1 * n2 / 12.0 * ((n + 1.0) - tie_term / (n * (n - 1.0)));
+    if (var <= 0.0) return u > mean ? 0.0 : 1.0;
+    const double z = (u - mean - 0.5) / std::sqrt(var);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
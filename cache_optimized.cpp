@@ -2,98 +2,348 @@
 High-Performance C++: Cache-optimized implementation
 Purpose: Same algorithm as the serial baseline with improved data locality and reduced memory overhead.
 Key ideas: 1D contiguous storage (row-major), constant hoisting, explicit boundary handling, and single-pass updates.
+           Rows use a padded stride (see stencil_grid.hpp) so power-of-two widths do not thrash cache sets.
+           The grid can also be stored tiled or in Morton order (--layout); every pass then walks the grid tile by
+           tile, one contiguous tile-row segment at a time, while hits are still reported in global (i, j).
+           For grids beyond the last-level cache vr is written with streaming stores (--nt-stores, stencil_kernels.hpp).
+           --prefetch=D adds software prefetches D rows ahead to the update and the scan; --prefetch=auto times a few
+           distances on the initial grid and keeps the fastest (the update is idempotent, so this changes no results).
+           When nx >> ny (the default 10000 x 200) the row-major grid is stored transposed (--transpose=auto|on|off):
+           storage row j holds column j, so the hot loops run over the long axis. Boundaries are addressed through
+           original (i, j) coordinates and the scan restores the (i, j) order of the hits, so results do not change.
+           Startup of big grids: --prefault=populate maps the grid with MAP_POPULATE, --prefault=parallel touches its
+           pages from a short-lived worker pool before the initialisation; [startup] reports the effect.
+           --fields=interleaved stores vi and vr interleaved in SIMD-width blocks (stencil_grid.hpp) so the scan and
+           the averaging pass read one stream instead of two. Every pass is written against a field accessor and
+           dispatched once per pass; [phases] reports update, boundary, scan and average time for either layout.
 */
 #include <iostream>  //for console output
 #include <fstream>   //for file output
 #include <cmath>     //for mathematical operations
 #include <chrono>
+#include <algorithm>
+#include <thread>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include "alloc_counter.hpp"
+#include "grid_dump.hpp"
+#include "machine_probe.hpp"
+#include "memory_report.hpp"
+#include "perf_counters.hpp"
+#include "phase_timer.hpp"
+#include "roofline.hpp"
+#include "stencil_grid.hpp"
+#include "stencil_kernels.hpp"
+#include "stencil_options.hpp"
+#include "step_arena.hpp"
+#include "step_latency.hpp"
+#include "trace_export.hpp"
+#include "usdt_probes.hpp"
+#include "worker_pool.hpp"
 
 using namespace std;
 
 int main(int argc, char* argv[]) {
-    int nx = 10000; //grid size (x)
-    int ny = 200;   //grid size (y)
-    int nt = 200;   //num of time steps
+    StartupProbe startup; // first: everything up to the first timestep counts as startup
     const double quarter = 0.25; // precomputed constants(replaced /4.0 with *quarter to improve speed)
     const double half = 0.5;     // ^^(replaced /2.0 with *half ^^)
     const double pi = 4.0 * atan(1.0); // portable pi calculation without relying on non-standard M_PI
 
-    // Optional CLI: nx ny nt
-    if (argc >= 4) {
-        nx = atoi(argv[1]);
-        ny = atoi(argv[2]);
-        nt = atoi(argv[3]);
+    // Optional CLI: nx ny nt [--pad=auto|off|lines] [--layout=row|tiled|morton] [--tile=64]
+    //               [--nt-stores=auto|on|off|compare] [--prefetch=D|auto] [--transpose=auto|on|off]
+    //               [--prefault=none|populate|parallel] [--threads=N] [--fields=separate|interleaved]
+    //               [--roofline[=csv]] [--perf] [--dump-grid=path] [--trace=path.json]
+    //               [--latency-hist=path.hgrm] [--quiet]
+    StencilOptions opt;
+    if (!parse_stencil_options(argc, argv, opt)) return 1;
+    const int nx = opt.nx, ny = opt.ny, nt = opt.nt;
+    const bool transposed = use_transposed_storage(opt);
+
+    // one page-aligned block holding both fields; grid.at(r, c) maps storage coordinates to an offset.
+    // Storage is rows x cols = nx x ny, or ny x nx when transposed; at(i, j) takes the original coordinates.
+    StencilGrid grid(transposed ? ny : nx, transposed ? nx : ny, opt.pad_lines, opt.layout, opt.tile, true,
+                     opt.prefault == StencilOptions::Prefault::Populate, opt.fields);
+    const int rows = grid.nx, cols = grid.ny;
+    auto at = [&](int i, int j) { return transposed ? grid.at(j, i) : grid.at(i, j); };
+
+    // every pass is written once against a field accessor and dispatched per layout (one visit per pass)
+    using Fields = variant<SeparateFields, InterleavedFields>;
+    const bool interleaved = opt.fields == FieldLayout::Interleaved;
+    const Fields fields = interleaved ? Fields(grid.interleaved()) : Fields(grid.separate());
+    auto with_fields = [&](auto&& pass) { visit(pass, fields); };
+
+    if (opt.prefault == StencilOptions::Prefault::Parallel) {
+        // take the page faults on all cores at once, so the single-threaded initialisation below runs fault-free
+        const int threads = opt.threads > 0 ? opt.threads : static_cast<int>(max(1u, thread::hardware_concurrency()));
+        WorkerPool pool(threads);
+        auto touch = [&](int tid) {
+            const size_t pages = grid.pages();
+            grid.touch_pages(pages * tid / threads, pages * (tid + 1) / threads);
+        };
+        pool.run(touch);
     }
 
-    //allocate memory using new
-    double* vi = new double[nx * ny]; //to store input vals
-    double* vr = new double[nx * ny]; //to store results
+    PhaseTimer timer(opt.trace.empty() ? kPhaseRingCapacity : kTraceRingCapacity); // TSC, spans (phase_timer.hpp)
+    timer.begin(kPhaseInit);
 
     // initialize vi and vr arrays
-    // Rationale: Iterate in row-major order (i outer, j inner) and use contiguous indexing (i*ny + j)
-    // to exploit spatial locality. Precompute i*i and sin(pi/nx*i) once per row to reduce redundant work.
-    for (int i = 0; i < nx; ++i) {
-        double i_sq = i * i, i_factor = sin(pi / nx * i); // combined initialization
-        for (int j = 0; j < ny; ++j) {
-            vi[i * ny + j] = i_sq * j * i_factor; // initialize vi
-            vr[i * ny + j] = 0.0;                //initialize vr to 0
+    // Rationale: Walk the storage in order (row segments of each tile; whole rows for row-major) so writes stay
+    // sequential. Precompute i*i and sin(pi/nx*i) once per segment (once per grid row when transposed).
+    with_fields([&](auto f) {
+        if (transposed) {
+            vector<double> i_sq(nx), i_factor(nx);
+            for (int i = 0; i < nx; ++i) {
+                i_sq[i] = i * i;
+                i_factor[i] = sin(pi / nx * i);
+            }
+            grid.for_each_segment([&](int j, int i0, int i1, size_t off) {
+                for (int i = i0; i < i1; ++i) {
+                    f.vi(off + (i - i0)) = i_sq[i] * j * i_factor[i];
+                    f.vr(off + (i - i0)) = 0.0;
+                }
+            });
+        } else {
+            grid.for_each_segment([&](int i, int j0, int j1, size_t off) {
+                double i_sq = i * i, i_factor = sin(pi / nx * i); // combined initialization
+                for (int j = j0; j < j1; ++j) {
+                    f.vi(off + (j - j0)) = i_sq * j * i_factor; // initialize vi
+                    f.vr(off + (j - j0)) = 0.0;                //initialize vr to 0
+                }
+            });
         }
-    }
+    });
+    timer.end(kPhaseInit);
 
-    ofstream fout("data_out"); //for writing results
+    auto fout = make_tracked<ofstream>(kMemOutput, "data_out"); //for writing results
     if (!fout) {
         cerr << "Error opening output file.\n";
         return 1; //terminate if file cannot be opened
     }
 
+    // streaming stores only pay off once vi + vr no longer fit in the last-level cache
+    // (separate fields only: an interleaved vr block is half a cache line)
+    const CacheSizes caches = detect_cache_sizes();
+    const size_t working_set = 2 * grid.field_bytes();
+    const bool use_nt = !interleaved && (opt.nt_stores == StencilOptions::NtStores::On ||
+                        (opt.nt_stores != StencilOptions::NtStores::Off && working_set > caches.llc));
+
+    // update vr based on vi (interior points)
+    // Improves L1/L2 cache locality by traversing contiguous memory and removing pointer indirections.
+    // The five-point stencil reuses neighboring elements that are likely resident in cache lines.
+    // In the tiled layouts rows i-1 and i+1 of a tile are still hot when the next tile row is updated.
+    // With a prefetch distance d > 0 the row d past the lowest row read (vi row i+1+d, vr row i+d) is prefetched.
+    // Here i and j are storage coordinates; when transposed the neighbours are passed to the kernel in the order
+    // (i+1, i-1, j-1, j+1) of the original grid so the sum matches the baseline bit for bit.
+    // Interleaved fields go through the accessor element by element (no streaming stores or software prefetch).
+    auto update_interior = [&](bool nt, int pf) {
+        with_fields([&](auto f) {
+            grid.for_each_segment([&](int i, int j0, int j1, size_t off) {
+                if (i == 0 || i == rows - 1) return;
+                int kb = max(j0, 1) - j0, ke = min(j1, cols - 1) - j0; // cells [kb, ke) of this segment are interior
+                if (kb >= ke) return;
+                const size_t up_off = grid.at(i - 1, j0), dn_off = grid.at(i + 1, j0);
+                // segment ends at a tile edge: the left/right neighbour lives in the adjacent tile
+                auto edge = [&](int k) {
+                    int j = j0 + k;
+                    f.vr(off + k) = (f.vi(grid.at(i + 1, j)) + f.vi(grid.at(i - 1, j)) +
+                                     f.vi(grid.at(i, j - 1)) + f.vi(grid.at(i, j + 1))) * quarter;
+                };
+                if (kb == 0) edge(kb++);
+                if (ke == j1 - j0 && kb < ke) edge(--ke);
+                if constexpr (is_same_v<decltype(f), SeparateFields>) {
+                    const double* vi = f.vi_base;
+                    double* vr = f.vr_base;
+                    const double* c = vi + off;
+                    const double* up = vi + up_off;
+                    const double* dn = vi + dn_off;
+                    double* out = vr + off;
+                    const double* pf_vi = pf > 0 && i + 1 + pf < rows ? vi + grid.at(i + 1 + pf, j0) : nullptr;
+                    double* pf_vr = pf > 0 && i + pf < rows ? vr + grid.at(i + pf, j0) : nullptr;
+                    const double *a = dn, *b = up, *l = c - 1, *r = c + 1;
+                    if (transposed) {
+                        a = c + 1;
+                        b = c - 1;
+                        l = up;
+                        r = dn;
+                    }
+                    if (nt) sum4_segment_nt(a, b, l, r, out, kb, ke, quarter, pf_vi);
+                    else if (pf > 0) sum4_segment_pf(a, b, l, r, out, kb, ke, quarter, pf_vi, pf_vr);
+                    else sum4_segment(a, b, l, r, out, kb, ke, quarter);
+                } else if (transposed) {
+                    for (int k = kb; k < ke; ++k) {
+                        f.vr(off + k) = (f.vi(off + k + 1) + f.vi(off + k - 1) +
+                                         f.vi(up_off + k) + f.vi(dn_off + k)) * quarter;
+                    }
+                } else {
+                    for (int k = kb; k < ke; ++k) {
+                        f.vr(off + k) = (f.vi(dn_off + k) + f.vi(up_off + k) +
+                                         f.vi(off + k - 1) + f.vi(off + k + 1)) * quarter;
+                    }
+                }
+            });
+        });
+        if (nt) stream_fence();
+    };
+
+    const int prefetch = interleaved ? 0 : opt.prefetch >= 0 ? opt.prefetch
+                                       : tune_prefetch_distance([&](int d) { update_interior(use_nt, d); }, cout);
+
     // iterate over time steps
+    PerfCounters perf(opt.perf, 1, nt); // hardware counters per phase (--perf), read at the timer's boundaries
+    perf.open_thread(0);
+    if (perf.active()) timer.observe(&perf);
+    StepAllocStats alloc_stats; // the timestep makes no heap allocations (alloc_counter.hpp)
+    StepBuffer<StencilHit> hit_buffer; // transposed scan: hits collected in storage order, then sorted to (i, j)
+    StepLatency latency(timer); // wall time of every step, HDR histogram (step_latency.hpp); calibrates the TSC
+    startup.first_step();       // after the calibration spin, which is startup work too
     auto t_start = std::chrono::high_resolution_clock::now();
     for (int t = 0; t < nt; ++t) {
-        cout << "\n" << t; cout.flush(); //print current time step to console
-
-        // update vr based on vi (interior points)
-        // Improves L1/L2 cache locality by traversing contiguous memory and removing pointer indirections.
-        // The five-point stencil reuses neighboring elements that are likely resident in cache lines.
-        for (int i = 1; i < nx - 1; ++i) {
-            for (int j = 1; j < ny - 1; ++j) {
-                vr[i * ny + j] = (vi[(i + 1) * ny + j] + vi[(i - 1) * ny + j] +
-                                  vi[i * ny + (j - 1)] + vi[i * ny + (j + 1)]) * quarter;
-            }
-        }
+        latency.begin_step(t);
+        STENCIL_PROBE1(step_begin, t);
+        hit_buffer.reset(); // grows the arena after an overflow, before the step is counted (see [arena] growths)
+        alloc_stats.begin_step();
+        if (!opt.quiet) { cout << "\n" << t; cout.flush(); } //print current time step to console
+        timer.set_step(t);
+
+        timer.begin(kPhaseUpdate);
+        update_interior(use_nt, prefetch);
+        timer.end(kPhaseUpdate);
 
         // handle boundary conditions explicitly (edges)
         // Move branches out of the hot interior loop to reduce branch mispredictions and keep the core loop tight.
-        for (int j = 1; j < ny - 1; ++j) { //for boundary rows
-            vr[0 * ny + j] = (vi[1 * ny + j] + 10.0 + vi[0 * ny + (j - 1)] + vi[0 * ny + (j + 1)]) * quarter; //top row
-            vr[(nx - 1) * ny + j] = (5.0 + vi[(nx - 2) * ny + j] +
-                                     vi[(nx - 1) * ny + (j - 1)] + vi[(nx - 1) * ny + (j + 1)]) * quarter; //bottom row
-        }
-        for (int i = 1; i < nx - 1; ++i) { //for boundary columns
-            vr[i * ny + 0] = (vi[(i + 1) * ny + 0] + vi[(i - 1) * ny + 0] + 15.45 + vi[i * ny + 1]) * quarter; //left column
-            vr[i * ny + (ny - 1)] = (vi[(i + 1) * ny + (ny - 1)] + vi[(i - 1) * ny + (ny - 1)] +
-                                     vi[i * ny + (ny - 2)] - 6.7) * quarter; //right column
-        }
+        // A grid one cell wide has no boundary the baseline updates (its edge cells lack a neighbour), so the row
+        // loops need nx > 1 and the column loops ny > 1.
+        timer.begin(kPhaseBoundaries);
+        with_fields([&](auto f) {
+            for (int j = 1; nx > 1 && j < ny - 1; ++j) { //for boundary rows
+                f.vr(at(0, j)) = (f.vi(at(1, j)) + 10.0 + f.vi(at(0, j - 1)) + f.vi(at(0, j + 1))) * quarter; //top row
+                f.vr(at(nx - 1, j)) = (5.0 + f.vi(at(nx - 2, j)) +
+                                       f.vi(at(nx - 1, j - 1)) + f.vi(at(nx - 1, j + 1))) * quarter; //bottom row
+            }
+            for (int i = 1; ny > 1 && i < nx - 1; ++i) { //for boundary columns
+                f.vr(at(i, 0)) = (f.vi(at(i + 1, 0)) + f.vi(at(i - 1, 0)) +
+                                  15.45 + f.vi(at(i, 1))) * quarter; //left column
+                f.vr(at(i, ny - 1)) = (f.vi(at(i + 1, ny - 1)) + f.vi(at(i - 1, ny - 1)) +
+                                       f.vi(at(i, ny - 2)) - 6.7) * quarter; //right column
+            }
+        });
+        timer.end(kPhaseBoundaries);
 
         // output results for specific conditions
-        for (int i = 0; i < nx; ++i) {
-            for (int j = 0; j < ny; ++j) {
-                if (fabs(fabs(vr[i * ny + j]) - fabs(vi[i * ny + j])) < 1e-2) { //check if within threshold
-                    fout << t << " " << i << " " << j << " " << fabs(vi[i * ny + j]) << " " << fabs(vr[i * ny + j]) << "\n"; //write to file
+        // Scanned in storage order; for the tiled layouts hits therefore come out tile by tile (still global i, j).
+        // Transposed storage is scanned column by column of the grid, so its hits are sorted back to (i, j) order.
+        timer.begin(kPhaseScan);
+        std::pmr::vector<StencilHit>& hits = hit_buffer.items();
+        with_fields([&](auto f) {
+            grid.for_each_segment([&](int i, int j0, int j1, size_t off) {
+                const size_t pf_off = prefetch > 0 && i + prefetch < rows ? grid.at(i + prefetch, j0) : 0;
+                for (int k = 0; k < j1 - j0; ++k) {
+                    if (pf_off && (k & 7) == 0) {
+                        __builtin_prefetch(&f.vi(pf_off + k), 0, 3);
+                        __builtin_prefetch(&f.vr(pf_off + k), 0, 3);
+                    }
+                    const double vi_k = f.vi(off + k), vr_k = f.vr(off + k);
+                    if (fabs(fabs(vr_k) - fabs(vi_k)) < 1e-2) { //check if within threshold
+                        if (transposed) hits.push_back({j0 + k, i, fabs(vi_k), fabs(vr_k)});
+                        else fout << t << " " << i << " " << j0 + k << " " << fabs(vi_k) << " " << fabs(vr_k)
+                                  << "\n"; //write to file
+                    }
                 }
-            }
+            });
+        });
+        if (transposed) {
+            sort(hits.begin(), hits.end(), [](const StencilHit& x, const StencilHit& y) {
+                return x.i != y.i ? x.i < y.i : x.j < y.j;
+            });
+            write_hits(fout, t, hits);
         }
+        timer.end(kPhaseScan);
 
-        // update vi array in a single loop
-        // Single pass over contiguous memory improves bandwidth utilization vs nested loops.
-        for (int i = 0; i < nx * ny; ++i) {
-            vi[i] = (vi[i] + vr[i]) * half; //average with vr
-        }
+        // update vi array one contiguous segment at a time
+        // Each segment is a single unit-stride pass; the padding between rows is never touched.
+        // Interleaved segments that start on a block boundary are averaged block by block (vi and vr share a line).
+        timer.begin(kPhaseAverage);
+        with_fields([&](auto f) {
+            grid.for_each_segment([&](int, int j0, int j1, size_t off) {
+                int k = 0;
+                if constexpr (is_same_v<decltype(f), InterleavedFields>) {
+                    constexpr int B = static_cast<int>(kFieldBlock);
+                    if (off % B == 0) {
+                        for (double* block = &f.vi(off); k + B <= j1 - j0; k += B, block += 2 * B) {
+                            for (int q = 0; q < B; ++q) block[q] = (block[q] + block[q + B]) * half;
+                        }
+                    }
+                }
+                for (; k < j1 - j0; ++k) {
+                    f.vi(off + k) = (f.vi(off + k) + f.vr(off + k)) * half; //average with vr
+                }
+            });
+        });
+        timer.end(kPhaseAverage);
+        perf.end_step();
+        alloc_stats.end_step();
+        STENCIL_PROBE1(step_end, t);
+        latency.end_step();
     }
     auto t_end = std::chrono::high_resolution_clock::now();
     auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(t_end - t_start).count();
     cout << "\n[chrono] time_ms=" << elapsed_ms << "\n";
-    // clean up memory
-    delete[] vi; // release allocated memory
-    delete[] vr; // ^^
+    auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count();
+    cout << "[chrono] time_us=" << elapsed_us << "\n";
+    startup.report(cout, prefault_name(opt.prefault));
+    alloc_stats.report(cout);
+    report_step_buffers(cout, &hit_buffer, 1);
+    report_memory(cout);
+    alloc_stats.warn_steady(cerr);
+
+    // effective bandwidth of the update: one read of vi and one write of vr per interior cell
+    const double update_bytes = 2.0 * sizeof(double) * max(0, nx - 2) * max(0, ny - 2);
+    cout << "[bw] update_GBps=" << update_bytes * nt / max(timer.seconds(kPhaseUpdate), 1e-12) * 1e-9
+         << " nt_stores=" << (use_nt ? "on" : "off") << " prefetch=" << prefetch
+         << " transposed=" << (transposed ? "yes" : "no") << " working_set=" << working_set
+         << " llc_bytes=" << caches.llc << " (" << caches.source << ")\n";
+    cout << "[phases] fields=" << field_layout_name(opt.fields);
+    for (Phase phase : {kPhaseUpdate, kPhaseBoundaries, kPhaseScan, kPhaseAverage}) {
+        cout << " " << phase_name(phase) << "_ms=" << timer.seconds(phase) * 1e3;
+    }
+    cout << "\n";
+    double phase_cells[kPhaseCount];
+    stencil_phase_cells(nx, ny, phase_cells);
+    timer.report(cout, phase_cells, nt);
+    latency.report(cout, nt);
+    if (!opt.latency_hist.empty() && latency.write_hgrm(opt.latency_hist)) {
+        cout << "[latency] wrote " << opt.latency_hist << "\n";
+    }
+    perf.report(cout, static_cast<double>(nx) * ny);
+    if (opt.roofline) {
+        const MachinePeaks peaks = measure_peaks(caches, 1, working_set);
+        vector<RooflineRow> roofline_rows;
+        for (Phase phase : {kPhaseUpdate, kPhaseBoundaries, kPhaseScan, kPhaseAverage}) {
+            roofline_rows.push_back({phase, phase_cost(phase, nx, ny, nt, !use_nt, interleaved), timer.seconds(phase)});
+        }
+        report_roofline(cout, "cache_optimized", peaks, roofline_rows, opt.roofline_csv);
+    }
+    if (opt.nt_stores == StencilOptions::NtStores::Compare) {
+        // the update only reads vi and writes vr, so it can be repeated on the final state for a side-by-side
+        for (bool nt_variant : {false, true}) {
+            const int reps = 5;
+            auto t0 = std::chrono::steady_clock::now();
+            for (int r = 0; r < reps; ++r) update_interior(nt_variant, prefetch);
+            const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            cout << "[bw] compare nt_stores=" << (nt_variant ? "on" : "off")
+                 << " update_GBps=" << update_bytes * reps / max(s, 1e-12) * 1e-9 << "\n";
+        }
+    }
+    if (!opt.trace.empty()) {
+        const TraceTrack track{"main", -1, &timer.ring()};
+        if (write_chrome_trace(opt.trace, "cache_optimized", &track, 1)) cout << "[trace] wrote " << opt.trace << "\n";
+    }
+    if (!opt.dump_grid.empty()) {
+        with_fields([&](auto f) {
+            write_grid_dump(opt.dump_grid, nx, ny, [&](long long i, long long j) { return f.vi(at(i, j)); });
+        });
+    }
+    // memory is released by StencilGrid
     return 0;
 }
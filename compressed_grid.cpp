@@ -0,0 +1,303 @@
+/*
+High-Performance C++: Compressed-grid implementation (lossy, fixed rate)
+Purpose: Explore very large domains with vi held in compressed 4x4 blocks (fixed_rate_codec.hpp) instead of raw doubles.
+Key ideas: The grid is stored as block rows of 4 grid rows; each block row is a fixed-size bit stream, so it can be
+           decoded and re-encoded independently. A timestep streams over the block rows with a three-strip window of
+           decoded old values (previous, current, next), computes vr and the threshold output for the current strip,
+           averages into a scratch strip and re-encodes it in place. Only four strips of raw doubles are ever live.
+           The rate (bits per value) sets memory and traffic: 16 bits/value is 4x smaller than raw doubles, 8 is 8x.
+           Results carry the codec's error; --reference runs the uncompressed algorithm and reports the difference.
+*/
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "alloc_counter.hpp"
+#include "grid_dump.hpp"
+#include "fixed_rate_codec.hpp"
+#include "memory_report.hpp"
+#include "stencil_options.hpp"
+#include "usdt_probes.hpp"
+
+using namespace std;
+
+static const double quarter = 0.25;
+static const double half = 0.5;
+
+// vr for global row i from the old rows i-1 (up), i (c) and i+1 (dn); up/dn may be null at the grid edges.
+// Cells the baseline never writes (corners, degenerate 1-wide grids) are 0.
+static void stencil_row(int64_t i, int64_t nx, int64_t ny,
+                        const double* up, const double* c, const double* dn, double* out)
+{
+    if (i > 0 && i < nx - 1) {
+        if (ny > 1) {
+            out[0] = (dn[0] + up[0] + 15.45 + c[1]) * quarter; //left column
+            out[ny - 1] = (dn[ny - 1] + up[ny - 1] + c[ny - 2] - 6.7) * quarter; //right column
+        } else {
+            out[0] = 0.0;
+        }
+        for (int64_t j = 1; j < ny - 1; ++j) {
+            out[j] = (dn[j] + up[j] + c[j - 1] + c[j + 1]) * quarter;
+        }
+        return;
+    }
+    fill(out, out + ny, 0.0);
+    if (nx > 1 && i == 0) {
+        for (int64_t j = 1; j < ny - 1; ++j) out[j] = (dn[j] + 10.0 + c[j - 1] + c[j + 1]) * quarter; //top row
+    } else if (nx > 1) {
+        for (int64_t j = 1; j < ny - 1; ++j) out[j] = (5.0 + up[j] + c[j - 1] + c[j + 1]) * quarter; //bottom row
+    }
+}
+
+static void init_row(int64_t i, int64_t nx, int64_t ny, double pi, double* row) {
+    double i_sq = static_cast<double>(i) * i, i_factor = sin(pi / nx * i);
+    for (int64_t j = 0; j < ny; ++j) row[j] = i_sq * j * i_factor;
+}
+
+// vi as compressed block rows. A strip is 4 rows x (4 * blocks_x) doubles; the padding beyond nx/ny is filled by
+// replicating the last valid row/column so partial blocks compress as well as full ones.
+class CompressedGrid {
+public:
+    CompressedGrid(int64_t nx, int64_t ny, int rate)
+        : nx_(nx), ny_(ny), codec_(rate), blocks_x_((ny + 3) / 4), block_rows_((nx + 3) / 4),
+          words_per_row_((blocks_x_ * codec_.block_bits() + 63) / 64),
+          words_(block_rows_ * words_per_row_, 0) {}
+
+    int64_t strip_width() const { return 4 * blocks_x_; }
+    int64_t block_rows() const { return block_rows_; }
+    size_t bytes() const { return words_.size() * sizeof(uint64_t); }
+
+    // strip: 4 rows of strip_width() doubles, rows beyond nx and columns beyond ny are padding
+    void encode_strip(int64_t br, double* strip) {
+        const int64_t w = strip_width();
+        const int64_t rows = min<int64_t>(4, nx_ - 4 * br);
+        for (int64_t r = 0; r < 4; ++r) {
+            double* row = strip + r * w;
+            if (r >= rows) copy(strip + (rows - 1) * w, strip + rows * w, row);
+            for (int64_t j = ny_; j < w; ++j) row[j] = row[ny_ - 1];
+        }
+        uint64_t* words = &words_[br * words_per_row_];
+        fill(words, words + words_per_row_, 0);
+        BitStream s(words);
+        double block[16];
+        for (int64_t bx = 0; bx < blocks_x_; ++bx) {
+            for (int y = 0; y < 4; ++y) {
+                for (int x = 0; x < 4; ++x) block[4 * y + x] = strip[y * w + 4 * bx + x];
+            }
+            codec_.encode(block, s);
+        }
+    }
+
+    void decode_strip(int64_t br, double* strip) const {
+        const int64_t w = strip_width();
+        BitStream s(const_cast<uint64_t*>(&words_[br * words_per_row_]));
+        double block[16];
+        for (int64_t bx = 0; bx < blocks_x_; ++bx) {
+            codec_.decode(s, block);
+            for (int y = 0; y < 4; ++y) {
+                for (int x = 0; x < 4; ++x) strip[y * w + 4 * bx + x] = block[4 * y + x];
+            }
+        }
+    }
+
+private:
+    int64_t nx_, ny_;
+    FixedRateCodec codec_;
+    int64_t blocks_x_, block_rows_, words_per_row_;
+    vector<uint64_t> words_;
+};
+
+// Largest round-trip error of the initial state at a given rate (used to turn --tolerance into a rate).
+static double initial_roundtrip_error(int64_t nx, int64_t ny, int rate, double pi) {
+    CompressedGrid probe(nx, ny, rate);
+    const int64_t w = probe.strip_width();
+    vector<double> strip(4 * w), back(4 * w);
+    double err = 0.0;
+    for (int64_t br = 0; br < probe.block_rows(); ++br) {
+        for (int64_t r = 0; r < 4 && 4 * br + r < nx; ++r) init_row(4 * br + r, nx, ny, pi, &strip[r * w]);
+        probe.encode_strip(br, strip.data());
+        probe.decode_strip(br, back.data());
+        for (int64_t r = 0; r < 4 && 4 * br + r < nx; ++r) {
+            for (int64_t j = 0; j < ny; ++j) err = max(err, fabs(strip[r * w + j] - back[r * w + j]));
+        }
+    }
+    return err;
+}
+
+int main(int argc, char* argv[]) {
+    const double pi = 4.0 * atan(1.0);
+
+    // Optional CLI: nx ny nt [--rate=bits_per_value] [--tolerance=max_abs_error] [--reference] [--dump-grid=path]
+    //               [--quiet]
+    // --tolerance bounds the round trip of the initial grid only; the error grows over the timesteps (--reference
+    // measures the final one and checks it against the tolerance).
+    int rate = 16;
+    double tolerance = -1.0; // < 0: use --rate
+    bool bad_tolerance = false;
+    bool reference = false;
+    StencilOptions opt;
+    auto extra = [&](const char* arg) {
+        const char* v = nullptr;
+        if ((v = stencil_flag_value(arg, "rate"))) rate = atoi(v);
+        else if ((v = stencil_flag_value(arg, "tolerance"))) {
+            char* end = nullptr;
+            tolerance = strtod(v, &end);
+            if (end == v || *end != '\0' || !(tolerance >= 0.0)) bad_tolerance = true;
+        }
+        else if (strcmp(arg, "--reference") == 0) reference = true;
+        else return false;
+        return true;
+    };
+    if (!parse_stencil_options(argc, argv, opt, extra)) return 1;
+    if (!supports_stencil_flags(opt, 0, argv[0])) return 1;
+    if (bad_tolerance) {
+        cerr << "--tolerance must be an absolute error >= 0.\n";
+        return 1;
+    }
+    if (rate < 1 || rate > 64) {
+        cerr << "--rate must be between 1 and 64 bits per value.\n";
+        return 1;
+    }
+    const int64_t nx = opt.nx, ny = opt.ny;
+    const int nt = opt.nt;
+
+    // Error-bound knob: smallest fixed rate whose round trip of the initial state stays within the tolerance.
+    if (tolerance >= 0.0) {
+        int lo = 1, hi = 64;
+        while (lo < hi) {
+            const int mid = (lo + hi) / 2;
+            if (initial_roundtrip_error(nx, ny, mid, pi) <= tolerance) hi = mid;
+            else lo = mid + 1;
+        }
+        rate = lo;
+        const double achieved = initial_roundtrip_error(nx, ny, rate, pi);
+        if (achieved > tolerance) {
+            cerr << "--tolerance=" << tolerance << " is out of reach: the initial grid round-trips with error "
+                 << achieved << " even at rate 64.\n";
+            return 1;
+        }
+        cout << "[zfp] tolerance=" << tolerance << " chosen_rate=" << rate << " initial_max_abs_error=" << achieved
+             << " (initial grid only; the error accumulates over the timesteps)\n";
+    }
+
+    auto grid = make_tracked<CompressedGrid>(kMemGrid, nx, ny, rate);
+    const int64_t w = grid.strip_width();
+    const int64_t nbr = grid.block_rows();
+    // window of decoded old strips (prev, cur, next), plus vr and the new values of the current strip
+    auto strips = make_tracked<vector<double>>(kMemGrid, 3 * 4 * w);
+    auto vr_strip = make_tracked<vector<double>>(kMemGrid, 4 * w);
+    auto new_strip = make_tracked<vector<double>>(kMemGrid, 4 * w);
+    double* prev = strips.data();
+    double* cur = prev + 4 * w;
+    double* next = cur + 4 * w;
+
+    for (int64_t br = 0; br < nbr; ++br) {
+        for (int64_t r = 0; r < 4 && 4 * br + r < nx; ++r) init_row(4 * br + r, nx, ny, pi, &new_strip[r * w]);
+        grid.encode_strip(br, new_strip.data());
+    }
+
+    auto fout = make_tracked<ofstream>(kMemOutput, "data_out");
+    if (!fout) {
+        cerr << "Error opening output file.\n";
+        return 1;
+    }
+    const size_t raw_bytes = static_cast<size_t>(nx * ny) * sizeof(double);
+    cout << "[zfp] rate=" << rate << " compressed_bytes=" << grid.bytes() << " raw_bytes=" << raw_bytes
+         << " ratio=" << static_cast<double>(raw_bytes) / grid.bytes() << "\n";
+
+    StepAllocStats alloc_stats; // the timestep makes no heap allocations (alloc_counter.hpp)
+    auto t_start = std::chrono::high_resolution_clock::now();
+    for (int t = 0; t < nt; ++t) {
+        STENCIL_PROBE1(step_begin, t);
+        alloc_stats.begin_step();
+        if (!opt.quiet) { cout << "\n" << t; cout.flush(); }
+
+        grid.decode_strip(0, cur);
+        if (nbr > 1) grid.decode_strip(1, next);
+        for (int64_t br = 0; br < nbr; ++br) {
+            const int64_t rows = min<int64_t>(4, nx - 4 * br);
+            for (int64_t r = 0; r < rows; ++r) {
+                const int64_t i = 4 * br + r;
+                const double* c = cur + r * w;
+                const double* up = i == 0 ? nullptr : (r > 0 ? c - w : prev + 3 * w);
+                const double* dn = i + 1 >= nx ? nullptr : (r < 3 ? c + w : next);
+                double* vr = &vr_strip[r * w];
+                stencil_row(i, nx, ny, up, c, dn, vr);
+                for (int64_t j = 0; j < ny; ++j) {
+                    if (fabs(fabs(vr[j]) - fabs(c[j])) < 1e-2) {
+                        fout << t << " " << i << " " << j << " " << fabs(c[j]) << " " << fabs(vr[j]) << "\n";
+                    }
+                }
+                for (int64_t j = 0; j < ny; ++j) new_strip[r * w + j] = (c[j] + vr[j]) * half;
+            }
+            // the old strip stays in the window as `prev`; only the stored copy is replaced
+            grid.encode_strip(br, new_strip.data());
+            double* recycled = prev;
+            prev = cur;
+            cur = next;
+            next = recycled;
+            if (br + 2 < nbr) grid.decode_strip(br + 2, next);
+        }
+        alloc_stats.end_step();
+        STENCIL_PROBE1(step_end, t);
+    }
+    auto t_end = std::chrono::high_resolution_clock::now();
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(t_end - t_start).count();
+    cout << "\n[chrono] time_ms=" << elapsed_ms << "\n";
+    auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count();
+    cout << "[chrono] time_us=" << elapsed_us << "\n";
+    alloc_stats.report(cout);
+    report_memory(cout);
+    alloc_stats.warn_steady(cerr);
+
+    if (!opt.dump_grid.empty()) {
+        // decoded values, one block row at a time
+        int64_t decoded = -1;
+        write_grid_dump(opt.dump_grid, nx, ny, [&](long long i, long long j) {
+            if (i / 4 != decoded) grid.decode_strip(decoded = i / 4, cur);
+            return cur[(i % 4) * w + j];
+        });
+    }
+    if (reference) {
+        // uncompressed two-grid run of the same problem; compare final states and hit counts
+        vector<double> vi(nx * ny), vr(nx * ny, 0.0);
+        for (int64_t i = 0; i < nx; ++i) init_row(i, nx, ny, pi, &vi[i * ny]);
+        ofstream fref("data_out.ref");
+        for (int t = 0; t < nt; ++t) {
+            for (int64_t i = 0; i < nx; ++i) {
+                stencil_row(i, nx, ny, i > 0 ? &vi[(i - 1) * ny] : nullptr, &vi[i * ny],
+                            i + 1 < nx ? &vi[(i + 1) * ny] : nullptr, &vr[i * ny]);
+            }
+            for (int64_t k = 0; k < nx * ny; ++k) {
+                if (fabs(fabs(vr[k]) - fabs(vi[k])) < 1e-2) {
+                    fref << t << " " << k / ny << " " << k % ny << " " << fabs(vi[k]) << " " << fabs(vr[k]) << "\n";
+                }
+            }
+            for (int64_t k = 0; k < nx * ny; ++k) vi[k] = (vi[k] + vr[k]) * half;
+        }
+        double max_abs = 0.0, sum_sq = 0.0, max_ref = 0.0;
+        for (int64_t br = 0; br < nbr; ++br) {
+            grid.decode_strip(br, cur);
+            for (int64_t r = 0; r < 4 && 4 * br + r < nx; ++r) {
+                for (int64_t j = 0; j < ny; ++j) {
+                    const double ref = vi[(4 * br + r) * ny + j];
+                    const double diff = fabs(cur[r * w + j] - ref);
+                    max_abs = max(max_abs, diff);
+                    sum_sq += diff * diff;
+                    max_ref = max(max_ref, fabs(ref));
+                }
+            }
+        }
+        cout << "[zfp] max_abs_error=" << max_abs << " rms_error=" << sqrt(sum_sq / (nx * ny))
+             << " max_rel_error=" << (max_ref > 0.0 ? max_abs / max_ref : 0.0) << " (reference hits in data_out.ref)\n";
+        if (tolerance >= 0.0) {
+            cout << "[zfp] final_error_within_tolerance=" << (max_abs <= tolerance ? "yes" : "no") << " (tolerance="
+                 << tolerance << ")\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+/*
+High-Performance C++: Fixed-rate transform codec for 4x4 blocks of doubles
+Purpose: In-tree lossy compression for the compressed-grid engine, following the ZFP scheme
+         (Lindstrom, "Fixed-Rate Compressed Floating-Point Arrays", 2014) for two dimensions.
+Key ideas: Each block is converted to block-floating-point (one shared exponent, 62-bit integers), decorrelated with
+           an orthogonal-ish integer lifting transform, reordered by sequency, mapped to negabinary and coded one bit
+           plane at a time with group testing. Coding stops after exactly 16 * rate bits, so every block has the same
+           size and any block can be decoded on its own.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Bit stream over 64-bit words; bit p lives in word p / 64 at position p % 64. Writes OR into zeroed words.
+class BitStream {
+public:
+    explicit BitStream(std::uint64_t* words) : words_(words), pos_(0) {}
+
+    void seek(std::uint64_t pos) { pos_ = pos; }
+    std::uint64_t tell() const { return pos_; }
+
+    unsigned write_bit(unsigned bit) {
+        if (bit) words_[pos_ >> 6] |= std::uint64_t(1) << (pos_ & 63);
+        ++pos_;
+        return bit;
+    }
+    // Writes the low n bits of x (n <= 64) and returns x >> n.
+    std::uint64_t write_bits(std::uint64_t x, unsigned n) {
+        if (n == 0) return x;
+        const std::uint64_t value = n == 64 ? x : x & ((std::uint64_t(1) << n) - 1);
+        const unsigned shift = pos_ & 63;
+        words_[pos_ >> 6] |= value << shift;
+        if (shift + n > 64) words_[(pos_ >> 6) + 1] |= value >> (64 - shift);
+        pos_ += n;
+        return n == 64 ? 0 : x >> n;
+    }
+    unsigned read_bit() {
+        const unsigned bit = (words_[pos_ >> 6] >> (pos_ & 63)) & 1u;
+        ++pos_;
+        return bit;
+    }
+    std::uint64_t read_bits(unsigned n) {
+        if (n == 0) return 0;
+        const unsigned shift = pos_ & 63;
+        std::uint64_t value = words_[pos_ >> 6] >> shift;
+        if (shift + n > 64) value |= words_[(pos_ >> 6) + 1] << (64 - shift);
+        pos_ += n;
+        return n == 64 ? value : value & ((std::uint64_t(1) << n) - 1);
+    }
+
+private:
+    std::uint64_t* words_;
+    std::uint64_t pos_;
+};
+
+class FixedRateCodec {
+public:
+    // rate: bits per value, 1..64 (a block of 16 values takes 16 * rate bits).
+    explicit FixedRateCodec(int rate) : maxbits_(16u * static_cast<unsigned>(std::clamp(rate, 1, 64))) {}
+
+    unsigned block_bits() const { return maxbits_; }
+
+    // Encodes 16 values (row-major 4x4: block[4 * y + x]) into exactly block_bits() bits at the stream position.
+    void encode(const double* block, BitStream& s) const {
+        const std::uint64_t start = s.tell();
+        double fmax = 0.0;
+        for (int k = 0; k < 16; ++k) fmax = std::max(fmax, std::fabs(block[k]));
+        int emax = 0;
+        if (fmax > 0.0) std::frexp(fmax, &emax);
+        const int biased = emax + kExpBias;
+        if (fmax > 0.0 && biased > 0 && maxbits_ > 1 + kExpBits) {
+            s.write_bits(2u * static_cast<unsigned>(biased) + 1u, 1 + kExpBits);
+            std::int64_t iblock[16];
+            for (int k = 0; k < 16; ++k) {
+                iblock[k] = static_cast<std::int64_t>(std::ldexp(block[k], kIntPrec - 2 - emax));
+            }
+            fwd_xform(iblock);
+            std::uint64_t ublock[16];
+            for (int k = 0; k < 16; ++k) ublock[k] = int2uint(iblock[kPerm[k]]);
+            encode_ints(s, maxbits_ - 1 - kExpBits, ublock);
+        } else {
+            s.write_bit(0); // all-zero (or unrepresentably small) block
+        }
+        s.seek(start + maxbits_); // fixed rate: pad to the block size (the words are already zero)
+    }
+
+    void decode(BitStream& s, double* block) const {
+        const std::uint64_t start = s.tell();
+        if (s.read_bit()) {
+            const int emax = static_cast<int>(s.read_bits(kExpBits)) - kExpBias;
+            std::uint64_t ublock[16];
+            decode_ints(s, maxbits_ - 1 - kExpBits, ublock);
+            std::int64_t iblock[16];
+            for (int k = 0; k < 16; ++k) iblock[kPerm[k]] = uint2int(ublock[k]);
+            inv_xform(iblock);
+            for (int k = 0; k < 16; ++k) {
+                block[k] = std::ldexp(static_cast<double>(iblock[k]), emax - (kIntPrec - 2));
+            }
+        } else {
+            std::fill(block, block + 16, 0.0);
+        }
+        s.seek(start + maxbits_);
+    }
+
+private:
+    static constexpr int kExpBits = 11;   // IEEE double exponent width
+    static constexpr int kExpBias = 1023;
+    static constexpr int kIntPrec = 64;
+    static constexpr std::uint64_t kNegabinaryMask = 0xaaaaaaaaaaaaaaaaull;
+    // sequency order of the 16 coefficients (index = x + 4 * y)
+    static constexpr unsigned char kPerm[16] = {0, 1, 4, 5, 2, 8, 6, 9, 3, 12, 10, 7, 13, 11, 14, 15};
+
+    unsigned maxbits_;
+
+    static std::uint64_t int2uint(std::int64_t x) {
+        return (static_cast<std::uint64_t>(x) + kNegabinaryMask) ^ kNegabinaryMask;
+    }
+    static std::int64_t uint2int(std::uint64_t x) {
+        return static_cast<std::int64_t>((x ^ kNegabinaryMask) - kNegabinaryMask);
+    }
+
+    // Forward/inverse decorrelating lifting step on 4 values p[0], p[s], p[2s], p[3s].
+    static void fwd_lift(std::int64_t* p, int s) {
+        std::int64_t x = p[0], y = p[s], z = p[2 * s], w = p[3 * s];
+        x += w; x >>= 1; w -= x;
+        z += y; z >>= 1; y -= z;
+        x += z; x >>= 1; z -= x;
+        w += y; w >>= 1; y -= w;
+        w += y >> 1; y -= w >> 1;
+        p[0] = x; p[s] = y; p[2 * s] = z; p[3 * s] = w;
+    }
+    static void inv_lift(std::int64_t* p, int s) {
+        std::int64_t x = p[0], y = p[s], z = p[2 * s], w = p[3 * s];
+        y += w >> 1; w -= y >> 1;
+        y += w; w *= 2; w -= y;
+        z += x; x *= 2; x -= z;
+        y += z; z *= 2; z -= y;
+        w += x; x *= 2; x -= w;
+        p[0] = x; p[s] = y; p[2 * s] = z; p[3 * s] = w;
+    }
+    static void fwd_xform(std::int64_t* p) {
+        for (int y = 0; y < 4; ++y) fwd_lift(p + 4 * y, 1);
+        for (int x = 0; x < 4; ++x) fwd_lift(p + x, 4);
+    }
+    static void inv_xform(std::int64_t* p) {
+        for (int x = 0; x < 4; ++x) inv_lift(p + x, 4);
+        for (int y = 0; y < 4; ++y) inv_lift(p + 4 * y, 1);
+    }
+
+    // Embedded bit-plane coding with group tests, most significant plane first, until `maxbits` are spent.
+    static void encode_ints(BitStream& s, unsigned maxbits, const std::uint64_t* data) {
+        unsigned bits = maxbits, n = 0;
+        for (unsigned k = kIntPrec; bits && k-- > 0;) {
+            std::uint64_t x = 0;
+            for (unsigned i = 0; i < 16; ++i) x += ((data[i] >> k) & 1u) << i;
+            const unsigned m = std::min(n, bits);
+            bits -= m;
+            x = s.write_bits(x, m);
+            for (; n < 16 && bits && (bits--, s.write_bit(!!x)); x >>= 1, n++)
+                for (; n < 16 - 1 && bits && (bits--, !s.write_bit(x & 1u)); x >>= 1, n++)
+                    ;
+        }
+    }
+    static void decode_ints(BitStream& s, unsigned maxbits, std::uint64_t* data) {
+        std::fill(data, data + 16, 0);
+        unsigned bits = maxbits, n = 0;
+        for (unsigned k = kIntPrec; bits && k-- > 0;) {
+            const unsigned m = std::min(n, bits);
+            bits -= m;
+            std::uint64_t x = s.read_bits(m);
+            for (; n < 16 && bits && (bits--, s.read_bit()); x += std::uint64_t(1) << n++)
+                for (; n < 16 - 1 && bits && (bits--, !s.read_bit()); n++)
+                    ;
+            for (unsigned i = 0; x; i++, x >>= 1) data[i] += (x & 1u) << k;
+        }
+    }
+};
@@ -0,0 +1,54 @@
+/*
+High-Performance C++: Final-grid dumps for cross-engine verification
+Purpose: Let any engine write its final vi in one storage-independent form (--dump-grid=path), so verify_engines can
+         compare engines cell by cell whatever their layout, padding, transposition, compression or file backing.
+Key ideas: A dump is a text header line "stencil_grid <nx> <ny>" followed by nx * ny native doubles in row-major
+           (i, j) order of the original grid. Engines pass an accessor at(i, j); values go out through a fixed
+           stack buffer, so dumping never touches the heap of an engine that counts its allocations.
+*/
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "usdt_probes.hpp"
+
+template <class At>
+bool write_grid_dump(const std::string& path, long long nx, long long ny, At at) {
+    STENCIL_PROBE2(checkpoint_begin, nx, ny);
+    std::ofstream out(path, std::ios::binary);
+    out << "stencil_grid " << nx << " " << ny << "\n";
+    double chunk[512];
+    std::size_t n = 0;
+    for (long long i = 0; i < nx; ++i) {
+        for (long long j = 0; j < ny; ++j) {
+            chunk[n++] = at(i, j);
+            if (n == 512) {
+                out.write(reinterpret_cast<const char*>(chunk), sizeof(chunk));
+                n = 0;
+            }
+        }
+    }
+    out.write(reinterpret_cast<const char*>(chunk), static_cast<std::streamsize>(n * sizeof(double)));
+    out.flush();
+    STENCIL_PROBE1(checkpoint_end, nx * ny * static_cast<long long>(sizeof(double)));
+    return out.good();
+}
+
+struct GridDump {
+    long long nx = 0, ny = 0;
+    std::vector<double> values; // (i, j) at i * ny + j
+};
+
+inline bool read_grid_dump(const std::string& path, GridDump& dump) {
+    std::ifstream in(path, std::ios::binary);
+    std::string tag;
+    if (!(in >> tag >> dump.nx >> dump.ny) || tag != "stencil_grid" || dump.nx < 0 || dump.ny < 0 || in.get() != '\n') {
+        return false;
+    }
+    dump.values.resize(static_cast<std::size_t>(dump.nx * dump.ny));
+    in.read(reinterpret_cast<char*>(dump.values.data()),
+            static_cast<std::streamsize>(dump.values.size() * sizeof(double)));
+    return static_cast<std::size_t>(in.gcount()) == dump.values.size() * sizeof(double);
+}
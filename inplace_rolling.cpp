@@ -0,0 +1,130 @@
+/*
+High-Performance C++: In-place rolling-row implementation
+Purpose: Same algorithm and output as the serial baseline with a single grid instead of two.
+Key ideas: Row i of the new state only depends on rows i-1, i, i+1 of the old state, so vi is overwritten row by row
+           while a small ring keeps the old copy of the previous row. The result of the stencil (vr) only ever
+           exists for one row at a time: it is scanned against the threshold and averaged into vi immediately.
+           Resident memory and write traffic drop to one field plus three rows.
+*/
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "alloc_counter.hpp"
+#include "grid_dump.hpp"
+#include "memory_report.hpp"
+#include "stencil_grid.hpp"
+#include "stencil_options.hpp"
+#include "usdt_probes.hpp"
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+    const double quarter = 0.25;
+    const double half = 0.5;
+    const double pi = 4.0 * atan(1.0);
+
+    // Optional CLI: nx ny nt [--pad=auto|off|lines] [--dump-grid=path] [--quiet]
+    StencilOptions opt;
+    if (!parse_stencil_options(argc, argv, opt)) return 1;
+    if (opt.layout != GridLayout::RowMajor) {
+        cerr << "This engine only supports --layout=row (the ring holds whole rows).\n";
+        return 1;
+    }
+    if (!supports_stencil_flags(opt, kFlagPad, argv[0])) return 1;
+    const int nx = opt.nx, ny = opt.ny, nt = opt.nt;
+
+    // vi only; vr is never materialised as a full grid
+    StencilGrid grid(nx, ny, opt.pad_lines, GridLayout::RowMajor, opt.tile, false);
+    double* vi = grid.vi;
+    const size_t stride = grid.stride;
+
+    // Ring of saved old rows (previous row, and the slot the current row is saved into) plus one vr row.
+    auto ring = make_tracked<vector<double>>(kMemGrid, 2 * stride);
+    auto vr_row = make_tracked<vector<double>>(kMemGrid, ny, 0.0);
+    double* prev = ring.data();           // old values of row i-1
+    double* saved = ring.data() + stride; // receives the old values of row i while it is overwritten
+
+    for (int i = 0; i < nx; ++i) {
+        double i_sq = i * i, i_factor = sin(pi / nx * i);
+        for (int j = 0; j < ny; ++j) {
+            vi[i * stride + j] = i_sq * j * i_factor;
+        }
+    }
+
+    auto fout = make_tracked<ofstream>(kMemOutput, "data_out");
+    if (!fout) {
+        cerr << "Error opening output file.\n";
+        return 1;
+    }
+    cout << "[memory] grid_bytes=" << grid.bytes() << " ring_bytes=" << (ring.size() + vr_row.size()) * sizeof(double)
+         << " (two-field engines hold two grids)\n";
+
+    StepAllocStats alloc_stats; // the timestep makes no heap allocations (alloc_counter.hpp)
+    auto t_start = std::chrono::high_resolution_clock::now();
+    for (int t = 0; t < nt; ++t) {
+        STENCIL_PROBE1(step_begin, t);
+        alloc_stats.begin_step();
+        if (!opt.quiet) { cout << "\n" << t; cout.flush(); }
+
+        for (int i = 0; i < nx; ++i) {
+            double* c = vi + i * stride;                           // row i, still holding the old state
+            const double* dn = (i + 1 < nx) ? c + stride : nullptr; // row i+1, untouched so far this step
+
+            // vr for row i; cells the baseline never writes (corners, degenerate 1-wide grids) stay 0
+            if (i > 0 && i < nx - 1) {
+                if (ny > 1) {
+                    vr_row[0] = (dn[0] + prev[0] + 15.45 + c[1]) * quarter; //left column
+                    vr_row[ny - 1] = (dn[ny - 1] + prev[ny - 1] + c[ny - 2] - 6.7) * quarter; //right column
+                } else {
+                    vr_row[0] = 0.0;
+                }
+                for (int j = 1; j < ny - 1; ++j) {
+                    vr_row[j] = (dn[j] + prev[j] + c[j - 1] + c[j + 1]) * quarter;
+                }
+            } else {
+                fill(vr_row.begin(), vr_row.end(), 0.0);
+                if (nx > 1 && i == 0) {
+                    for (int j = 1; j < ny - 1; ++j) {
+                        vr_row[j] = (dn[j] + 10.0 + c[j - 1] + c[j + 1]) * quarter; //top row
+                    }
+                } else if (nx > 1) {
+                    for (int j = 1; j < ny - 1; ++j) {
+                        vr_row[j] = (5.0 + prev[j] + c[j - 1] + c[j + 1]) * quarter; //bottom row
+                    }
+                }
+            }
+
+            // threshold output for row i, against the old vi exactly as the two-grid engines do
+            for (int j = 0; j < ny; ++j) {
+                if (fabs(fabs(vr_row[j]) - fabs(c[j])) < 1e-2) {
+                    fout << t << " " << i << " " << j << " " << fabs(c[j]) << " " << fabs(vr_row[j]) << "\n";
+                }
+            }
+
+            // save the old row for row i+1, then average in place; the saved slot becomes `prev`
+            for (int j = 0; j < ny; ++j) {
+                saved[j] = c[j];
+                c[j] = (c[j] + vr_row[j]) * half;
+            }
+            swap(prev, saved);
+        }
+        alloc_stats.end_step();
+        STENCIL_PROBE1(step_end, t);
+    }
+    auto t_end = std::chrono::high_resolution_clock::now();
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(t_end - t_start).count();
+    cout << "\n[chrono] time_ms=" << elapsed_ms << "\n";
+    auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count();
+    cout << "[chrono] time_us=" << elapsed_us << "\n";
+    alloc_stats.report(cout);
+    report_memory(cout);
+    alloc_stats.warn_steady(cerr);
+    if (!opt.dump_grid.empty()) {
+        write_grid_dump(opt.dump_grid, nx, ny, [&](long long i, long long j) { return vi[i * stride + j]; });
+    }
+
+    return 0;
+}
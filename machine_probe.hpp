@@ -0,0 +1,139 @@
+/*
+High-Performance C++: Machine description for the tuning decisions of the engines
+Purpose: Find the data cache sizes and core topology of the host so kernels can pick variants by working-set size,
+         read the process's page-fault counters for the startup report, and describe the host for benchmark records.
+Notes: Linux exposes the hierarchy in /sys/devices/system/cpu/cpu0/cache; elsewhere (or in restricted containers)
+       conservative defaults are used and `source` says so.
+*/
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+struct CacheSizes {
+    std::size_t l1d = 32 * 1024;          // per core
+    std::size_t l2 = 1024 * 1024;         // per core
+    std::size_t llc = 8 * 1024 * 1024;    // last level, shared
+    std::string source = "defaults";
+};
+
+// Parses sysfs sizes such as "48K", "2048K" or "300M".
+inline std::size_t parse_cache_size(const std::string& text) {
+    std::size_t value = 0, pos = 0;
+    while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') value = value * 10 + (text[pos++] - '0');
+    if (pos < text.size() && (text[pos] == 'K' || text[pos] == 'k')) value *= 1024;
+    else if (pos < text.size() && (text[pos] == 'M' || text[pos] == 'm')) value *= 1024 * 1024;
+    return value;
+}
+
+inline CacheSizes detect_cache_sizes() {
+    CacheSizes sizes;
+#ifdef __linux__
+    int deepest = 0;
+    for (int index = 0; index < 8; ++index) {
+        const std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/";
+        std::ifstream level_file(dir + "level"), type_file(dir + "type"), size_file(dir + "size");
+        int level = 0;
+        std::string type, size_text;
+        if (!(level_file >> level) || !(type_file >> type) || !(size_file >> size_text)) continue;
+        if (type == "Instruction") continue;
+        const std::size_t bytes = parse_cache_size(size_text);
+        if (bytes == 0) continue;
+        if (level == 1) sizes.l1d = bytes;
+        else if (level == 2) sizes.l2 = bytes;
+        if (level >= deepest) {
+            deepest = level;
+            sizes.llc = bytes;
+        }
+        sizes.source = "sysfs";
+    }
+#endif
+    return sizes;
+}
+
+// Logical CPUs, physical cores and packages (sockets) from /sys/devices/system/cpu/cpuN/topology.
+struct CpuTopology {
+    int logical = 0;
+    int cores = 0;
+    int packages = 0;
+    std::string source = "defaults";
+};
+
+inline CpuTopology detect_topology() {
+    CpuTopology topo;
+    topo.logical = static_cast<int>(std::thread::hardware_concurrency());
+    topo.cores = topo.logical;
+    topo.packages = 1;
+#ifdef __linux__
+    std::set<std::pair<int, int>> cores; // (package, core id)
+    std::set<int> packages;
+    int logical = 0;
+    for (int cpu = 0;; ++cpu) {
+        const std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        std::ifstream core_file(dir + "core_id"), package_file(dir + "physical_package_id");
+        int core = 0, package = 0;
+        if (!(core_file >> core) || !(package_file >> package)) break;
+        cores.insert({package, core});
+        packages.insert(package);
+        ++logical;
+    }
+    if (logical > 0) {
+        topo.logical = logical;
+        topo.cores = static_cast<int>(cores.size());
+        topo.packages = static_cast<int>(packages.size());
+        topo.source = "sysfs";
+    }
+#endif
+    return topo;
+}
+
+struct PageFaults {
+    long minor = 0; // served without I/O (first touch of anonymous memory)
+    long major = 0; // needed I/O
+};
+
+inline PageFaults page_faults() {
+    PageFaults faults;
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        faults.minor = usage.ru_minflt;
+        faults.major = usage.ru_majflt;
+    }
+#endif
+    return faults;
+}
+
+// Who ran a benchmark: host name, CPU model (Linux /proc/cpuinfo) and hardware threads.
+struct HostInfo {
+    std::string name = "unknown";
+    std::string cpu = "unknown";
+    unsigned threads = 0;
+};
+
+inline HostInfo describe_host() {
+    HostInfo host;
+    host.threads = std::thread::hardware_concurrency();
+#if defined(__unix__) || defined(__APPLE__)
+    char name[256] = {};
+    if (gethostname(name, sizeof(name) - 1) == 0 && name[0]) host.name = name;
+#endif
+#ifdef __linux__
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    for (std::string line; std::getline(cpuinfo, line);) {
+        if (line.compare(0, 10, "model name") != 0) continue;
+        const std::size_t colon = line.find(':');
+        if (colon != std::string::npos && colon + 2 <= line.size()) host.cpu = line.substr(colon + 2);
+        break;
+    }
+#endif
+    return host;
+}
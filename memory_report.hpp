@@ -0,0 +1,132 @@
+/*
+High-Performance C++: Memory footprint of a run
+Purpose: Say how much memory an engine and mode need: peak and current RSS, page faults, transparent huge page
+         coverage, and the bytes held by each subsystem (grids, index tables, output buffers, I/O bands, timing rings),
+         so jobs can be packed onto a node by measured footprint rather than by guess.
+Key ideas: Process figures come from getrusage (peak RSS, faults) and /proc/self/smaps_rollup (Rss, Pss, Anonymous,
+           AnonHugePages, Swap). Subsystem bytes come from the tracked operator new of alloc_counter.hpp: every block is
+           charged to the tag of the allocating thread's innermost MemoryScope (kMemOther outside any scope) and
+           remembers it, so freeing it credits the same tag. Memory that does not come from operator new (mmap'ed
+           grids) is charged explicitly with memory_charge().
+Notes: Programs without alloc_counter.hpp only see the explicit charges. Fields that the platform does not provide
+       are printed as -1 (smaps_rollup needs Linux 4.14).
+*/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include "machine_probe.hpp"
+
+enum MemoryTag { kMemOther, kMemGrid, kMemIndex, kMemOutput, kMemIo, kMemTiming, kMemTagCount };
+
+inline const char* memory_tag_name(int tag) {
+    static const char* const names[kMemTagCount] = {"other", "grid", "index", "output", "io", "timing"};
+    return tag >= 0 && tag < kMemTagCount ? names[tag] : "?";
+}
+
+struct MemoryBytes {
+    std::atomic<std::int64_t> live{0}, peak{0};
+
+    void add(std::int64_t bytes) {
+        const std::int64_t now = live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        std::int64_t high = peak.load(std::memory_order_relaxed);
+        while (now > high && !peak.compare_exchange_weak(high, now, std::memory_order_relaxed)) {
+        }
+    }
+};
+
+inline MemoryBytes g_memory_tags[kMemTagCount];
+inline MemoryBytes g_memory_total;
+inline thread_local int g_memory_tag = kMemOther;
+
+inline int memory_tag() { return g_memory_tag; }
+
+// Charges (or with negative bytes, credits) a subsystem.
+inline void memory_charge(int tag, std::int64_t bytes) {
+    g_memory_tags[tag].add(bytes);
+    g_memory_total.add(bytes);
+}
+
+// Allocations of this thread inside the scope are charged to `tag`.
+class MemoryScope {
+public:
+    explicit MemoryScope(MemoryTag tag) : saved_(g_memory_tag) { g_memory_tag = tag; }
+    ~MemoryScope() { g_memory_tag = saved_; }
+    MemoryScope(const MemoryScope&) = delete;
+    MemoryScope& operator=(const MemoryScope&) = delete;
+
+private:
+    int saved_;
+};
+
+// Constructs T(args...) with its allocations charged to `tag`, for containers that outlive any scope.
+template <class T, class... Args>
+T make_tracked(MemoryTag tag, Args&&... args) {
+    MemoryScope scope(tag);
+    return T(std::forward<Args>(args)...);
+}
+
+struct ProcessMemory {
+    long peak_rss_kb = -1;
+    long rss_kb = -1, pss_kb = -1, anon_kb = -1, anon_huge_kb = -1, swap_kb = -1; // smaps_rollup
+    std::string thp = "unknown"; // transparent huge page mode: always, madvise or never
+};
+
+inline ProcessMemory process_memory() {
+    ProcessMemory mem;
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        mem.peak_rss_kb = usage.ru_maxrss / 1024; // bytes there
+#else
+        mem.peak_rss_kb = usage.ru_maxrss;
+#endif
+    }
+#endif
+#ifdef __linux__
+    std::ifstream rollup("/proc/self/smaps_rollup");
+    std::string line;
+    while (std::getline(rollup, line)) {
+        char key[64];
+        long kb = 0;
+        if (std::sscanf(line.c_str(), "%63[^:]: %ld kB", key, &kb) != 2) continue;
+        const std::string name = key;
+        if (name == "Rss") mem.rss_kb = kb;
+        else if (name == "Pss") mem.pss_kb = kb;
+        else if (name == "Anonymous") mem.anon_kb = kb;
+        else if (name == "AnonHugePages") mem.anon_huge_kb = kb;
+        else if (name == "Swap") mem.swap_kb = kb;
+    }
+    std::ifstream thp("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string modes;
+    if (std::getline(thp, modes)) {
+        const std::size_t open = modes.find('['), close = modes.find(']');
+        if (open != std::string::npos && close > open) mem.thp = modes.substr(open + 1, close - open - 1);
+    }
+#endif
+    return mem;
+}
+
+// "[memory] ..." lines: process footprint and faults, then live and peak bytes per subsystem.
+inline void report_memory(std::ostream& out) {
+    const ProcessMemory mem = process_memory();
+    const PageFaults faults = page_faults();
+    out << "[memory] peak_rss_kb=" << mem.peak_rss_kb << " rss_kb=" << mem.rss_kb << " pss_kb=" << mem.pss_kb
+        << " anon_kb=" << mem.anon_kb << " anon_huge_kb=" << mem.anon_huge_kb << " huge_pct="
+        << (mem.anon_kb > 0 && mem.anon_huge_kb >= 0 ? 100.0 * mem.anon_huge_kb / mem.anon_kb : 0.0)
+        << " thp=" << mem.thp << " swap_kb=" << mem.swap_kb << " minor_faults=" << faults.minor
+        << " major_faults=" << faults.major << "\n";
+    out << "[memory] tracked_peak_bytes=" << g_memory_total.peak.load() << " tracked_live_bytes="
+        << g_memory_total.live.load() << "\n";
+    for (int tag = 0; tag < kMemTagCount; ++tag) {
+        if (g_memory_tags[tag].peak.load() == 0) continue;
+        out << "[memory] subsystem=" << memory_tag_name(tag) << " peak_bytes=" << g_memory_tags[tag].peak.load()
+            << " live_bytes=" << g_memory_tags[tag].live.load() << "\n";
+    }
+}
@@ -0,0 +1,381 @@
+/*
+High-Performance C++: Out-of-core streaming implementation
+Purpose: Run the same stencil on grids larger than RAM by keeping vi in a file on local disk.
+Key ideas: The grid is processed as bands of rows. Each band is loaded with k halo rows on either side and advanced
+           k timesteps in memory (temporal blocking), so one read and one write of the file serve k steps. The halo
+           below a band has already been overwritten on disk by the previous band, so its old rows are carried over in
+           memory. Reading the next band and writing the previous one run on two persistent I/O threads while the
+           current band is computed. All row/cell arithmetic is 64-bit; nx * ny may exceed 2^31.
+           Hits of a pass are buffered per step in arena-backed vectors (step_arena.hpp), so a pass in the steady
+           state makes no heap allocations.
+*/
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include "alloc_counter.hpp"
+#include "bench_engines.hpp"
+#include "grid_dump.hpp"
+#include "memory_report.hpp"
+#include "stencil_options.hpp"
+#include "step_arena.hpp"
+#include "trace_export.hpp"
+#include "usdt_probes.hpp"
+#include "worker_pool.hpp"
+
+using namespace std;
+
+static const double quarter = 0.25;
+static const double half = 0.5;
+
+// vr for global row i from the old rows i-1 (up), i (c) and i+1 (dn); up/dn may be null at the grid edges.
+// Cells the baseline never writes (corners, degenerate 1-wide grids) are 0.
+static void stencil_row(int64_t i, int64_t nx, int64_t ny,
+                        const double* up, const double* c, const double* dn, double* out)
+{
+    if (i > 0 && i < nx - 1) {
+        if (ny > 1) {
+            out[0] = (dn[0] + up[0] + 15.45 + c[1]) * quarter; //left column
+            out[ny - 1] = (dn[ny - 1] + up[ny - 1] + c[ny - 2] - 6.7) * quarter; //right column
+        } else {
+            out[0] = 0.0;
+        }
+        for (int64_t j = 1; j < ny - 1; ++j) {
+            out[j] = (dn[j] + up[j] + c[j - 1] + c[j + 1]) * quarter;
+        }
+        return;
+    }
+    fill(out, out + ny, 0.0);
+    if (nx > 1 && i == 0) {
+        for (int64_t j = 1; j < ny - 1; ++j) out[j] = (dn[j] + 10.0 + c[j - 1] + c[j + 1]) * quarter; //top row
+    } else if (nx > 1) {
+        for (int64_t j = 1; j < ny - 1; ++j) out[j] = (5.0 + up[j] + c[j - 1] + c[j + 1]) * quarter; //bottom row
+    }
+}
+
+static void scan_row(pmr::vector<StencilHit>& hits, int64_t i, int64_t ny, const double* vi_row, const double* vr_row) {
+    for (int64_t j = 0; j < ny; ++j) {
+        if (fabs(fabs(vr_row[j]) - fabs(vi_row[j])) < 1e-2) hits.push_back({i, j, fabs(vi_row[j]), fabs(vr_row[j])});
+    }
+}
+
+static void init_row(int64_t i, int64_t nx, int64_t ny, double pi, double* row) {
+    double i_sq = static_cast<double>(i) * i, i_factor = sin(pi / nx * i);
+    for (int64_t j = 0; j < ny; ++j) row[j] = i_sq * j * i_factor;
+}
+
+// Unbuffered binary file of nx rows x ny doubles; each instance is used by one thread at a time.
+class RowFile {
+public:
+    RowFile(const string& path, int64_t ny, bool create) : ny_(ny) {
+        f_.rdbuf()->pubsetbuf(nullptr, 0); // whole-band transfers; no stale read buffer between passes
+        ios::openmode mode = ios::in | ios::out | ios::binary;
+        if (create) mode |= ios::trunc;
+        f_.open(path, mode);
+    }
+    bool ok() const { return static_cast<bool>(f_); }
+    void read_rows(int64_t first, int64_t count, double* dst) {
+        f_.seekg(static_cast<streamoff>(first * ny_ * sizeof(double)));
+        f_.read(reinterpret_cast<char*>(dst), static_cast<streamsize>(count * ny_ * sizeof(double)));
+    }
+    void write_rows(int64_t first, int64_t count, const double* src) {
+        f_.seekp(static_cast<streamoff>(first * ny_ * sizeof(double)));
+        f_.write(reinterpret_cast<const char*>(src), static_cast<streamsize>(count * ny_ * sizeof(double)));
+    }
+    void flush() { f_.flush(); }
+
+private:
+    fstream f_;
+    int64_t ny_;
+};
+
+// --compare: the optimized in-memory engine (cache_optimized.exe next to this executable; bitwise identical to the
+// serial engine, see verify_engines) runs the same problem with the temporary directory as its working directory, so
+// its data_out does not replace ours, and dumps its final grid there. Returns its time_us (-1 on failure); the
+// directory is removed by the caller.
+static double run_reference(const string& self, const filesystem::path& dir, int64_t nx, int64_t ny, int nt) {
+    const filesystem::path exe =
+        filesystem::absolute(filesystem::path(self).parent_path() / find_engine("optimized")->exe);
+    if (!filesystem::exists(exe)) {
+        cerr << "--compare needs " << exe.string() << "\n";
+        return -1.0;
+    }
+    const string cmd = "\"" + exe.string() + "\" " + to_string(nx) + " " + to_string(ny) + " " + to_string(nt) +
+                       " --quiet --dump-grid=reference.grid 2>&1";
+    const filesystem::path cwd = filesystem::current_path();
+    filesystem::current_path(dir); // the child inherits it; nothing else runs while it is changed
+    FILE* pipe = popen(cmd.c_str(), "r");
+    double time_us = -1.0;
+    if (pipe) {
+        char line[256];
+        while (fgets(line, sizeof(line), pipe)) {
+            if (strncmp(line, "[chrono] time_us=", 17) == 0) time_us = atof(line + 17);
+        }
+        if (pclose(pipe) != 0) time_us = -1.0;
+    }
+    filesystem::current_path(cwd);
+    return time_us;
+}
+
+// Hit files compared as sorted records: the engines agree on the records, not on the order tiled layouts emit them in.
+static bool same_hits(const string& a, const string& b) {
+    auto records = [](const string& path) {
+        ifstream in(path);
+        vector<string> lines;
+        for (string line; getline(in, line);) {
+            if (!line.empty()) lines.push_back(line);
+        }
+        sort(lines.begin(), lines.end());
+        return lines;
+    };
+    return records(a) == records(b);
+}
+
+int main(int argc, char* argv[]) {
+    const double pi = 4.0 * atan(1.0);
+
+    // Optional CLI: nx ny nt [--grid-file=path] [--band-rows=N] [--tblock=k] [--keep-file] [--compare]
+    //               [--dump-grid=path] [--trace=path.json] [--quiet]
+    string grid_path = "grid_ooc.bin";
+    int64_t band_rows = 4096;
+    int tblock = 4;
+    bool keep_file = false, compare = false;
+    StencilOptions opt;
+    auto extra = [&](const char* arg) {
+        const char* v = nullptr;
+        if ((v = stencil_flag_value(arg, "grid-file"))) grid_path = v;
+        else if ((v = stencil_flag_value(arg, "band-rows"))) band_rows = strtoll(v, nullptr, 10);
+        else if ((v = stencil_flag_value(arg, "tblock"))) tblock = atoi(v);
+        else if (strcmp(arg, "--keep-file") == 0) keep_file = true;
+        else if (strcmp(arg, "--compare") == 0) compare = true;
+        else return false;
+        return true;
+    };
+    if (!parse_stencil_options(argc, argv, opt, extra)) return 1;
+    if (!supports_stencil_flags(opt, kFlagTrace, argv[0])) return 1; // row bands of an unpadded file
+    if (tblock < 1 || band_rows < 1) {
+        cerr << "--tblock and --band-rows must be positive.\n";
+        return 1;
+    }
+    const int64_t nx = opt.nx, ny = opt.ny;
+    const int nt = opt.nt;
+    band_rows = min(max(band_rows, static_cast<int64_t>(tblock)), nx); // a band must cover the halo it carries
+
+    // Create the grid file with the initial state, one band at a time.
+    {
+        RowFile init_file(grid_path, ny, true);
+        if (!init_file.ok()) {
+            cerr << "Error creating grid file " << grid_path << "\n";
+            return 1;
+        }
+        auto rows = make_tracked<vector<double>>(kMemIo, band_rows * ny);
+        for (int64_t r0 = 0; r0 < nx; r0 += band_rows) {
+            const int64_t n = min(band_rows, nx - r0);
+            for (int64_t i = r0; i < r0 + n; ++i) init_row(i, nx, ny, pi, &rows[(i - r0) * ny]);
+            init_file.write_rows(r0, n, rows.data());
+        }
+        init_file.flush();
+    }
+
+    RowFile reader(grid_path, ny, false), writer(grid_path, ny, false);
+    auto fout = make_tracked<ofstream>(kMemOutput, "data_out");
+    if (!reader.ok() || !writer.ok() || !fout) {
+        cerr << "Error opening output file.\n";
+        return 1;
+    }
+
+    // Three band buffers rotate between "being read ahead", "being computed" and "being written behind".
+    const int64_t max_rows = band_rows + 2 * static_cast<int64_t>(tblock);
+    vector<double> band_buf[3];
+    {
+        MemoryScope scope(kMemIo);
+        for (auto& b : band_buf) b.resize(max_rows * ny);
+    }
+    auto vr_buf = make_tracked<vector<double>>(kMemIo, max_rows * ny);
+    auto halo_in = make_tracked<vector<double>>(kMemIo, static_cast<int64_t>(tblock) * ny);
+    auto halo_out = make_tracked<vector<double>>(kMemIo, static_cast<int64_t>(tblock) * ny);
+    auto step_hits = make_unique<StepBuffer<StencilHit>[]>(tblock); // hits of each step in the pass, band by band
+    WorkerPool reader_pool(1), writer_pool(1);                         // read-ahead and write-behind threads
+    cout << "[ooc] band_rows=" << band_rows << " tblock=" << tblock << " resident_bytes="
+         << (3 * max_rows * ny + max_rows * ny + 2 * static_cast<int64_t>(tblock) * ny) * sizeof(double)
+         << " grid_bytes=" << nx * ny * static_cast<int64_t>(sizeof(double)) << "\n";
+
+    // --trace: spans of the compute thread (phases of every band and step, waits for the I/O threads) and of the
+    // reader and writer threads (trace_export.hpp); without it the rings stay empty
+    const size_t ring_capacity = opt.trace.empty() ? 0 : kTraceRingCapacity;
+    PhaseRing compute_ring(ring_capacity), read_ring(ring_capacity, 0), write_ring(ring_capacity, 1);
+
+    int64_t bytes_read = 0, bytes_written = 0;
+    StepAllocStats alloc_stats; // per pass of tblock steps; zero in the steady state (alloc_counter.hpp)
+    auto t_start = std::chrono::high_resolution_clock::now();
+    for (int t = 0; t < nt; t += tblock) {
+        const int k = min(tblock, nt - t);
+        STENCIL_PROBE2(pass_begin, t, k);
+        for (int s = 0; s < tblock; ++s) step_hits[s].reset(); // growth: see [arena] growths
+        alloc_stats.begin_step();
+        if (!opt.quiet) { cout << "\n" << t; cout.flush(); }
+
+        // rows [r0, r1) of the band starting at r0 are loaded as [a, e) = [r0 - k, r1 + k) clipped to the grid
+        auto band_region = [&](int64_t r0, int64_t& a, int64_t& e) {
+            a = max<int64_t>(0, r0 - k);
+            e = min(nx, r0 + band_rows + k);
+        };
+        // rows [r0, e) come from disk; rows [a, r0) are the carried halo
+        auto read_band = [&](int64_t r0, double* dst) {
+            int64_t a, e;
+            band_region(r0, a, e);
+            reader.read_rows(r0, e - r0, dst + (r0 - a) * ny);
+            STENCIL_PROBE3(io_read, t, r0, (e - r0) * ny * static_cast<int64_t>(sizeof(double)));
+        };
+
+        // the I/O tasks read their arguments from these; each is only changed while its thread is idle
+        int64_t read_r0 = 0, write_r0 = 0, write_r1 = 0, write_a = 0;
+        double* read_dst = nullptr;
+        const double* write_src = nullptr;
+        auto read_task = [&](int) {
+            ScopedSpan span(read_ring, kPhaseRead, t);
+            read_band(read_r0, read_dst);
+        };
+        auto write_task = [&](int) {
+            ScopedSpan span(write_ring, kPhaseWrite, t);
+            writer.write_rows(write_r0, write_r1 - write_r0, write_src + (write_r0 - write_a) * ny);
+            STENCIL_PROBE3(io_write, t, write_r0, (write_r1 - write_r0) * ny * static_cast<int64_t>(sizeof(double)));
+        };
+
+        int cur = 0;
+        read_dst = band_buf[cur].data();
+        reader_pool.start(read_task);
+        for (int64_t r0 = 0; r0 < nx; r0 += band_rows) {
+            const int64_t r1 = min(nx, r0 + band_rows);
+            int64_t a, e;
+            band_region(r0, a, e);
+            double* vi_b = band_buf[cur].data(); // local row r - a holds global row r
+            {
+                ScopedSpan span(compute_ring, kPhaseWait, t);
+                reader_pool.wait();
+            }
+            bytes_read += (e - r0) * ny * static_cast<int64_t>(sizeof(double));
+
+            // carried halo (old rows [a, r0)) in; old rows [r1 - k, r1) out for the next band
+            copy(halo_in.begin(), halo_in.begin() + (r0 - a) * ny, vi_b);
+            if (r1 < nx) copy(vi_b + (r1 - k - a) * ny, vi_b + (r1 - a) * ny, halo_out.begin());
+
+            // read ahead: the next band's rows above r1 are still at time t on disk
+            const int next = (cur + 1) % 3;
+            if (r1 < nx) {
+                read_r0 = r1;
+                read_dst = band_buf[next].data();
+                reader_pool.start(read_task);
+            }
+
+            // k timesteps on the band; the valid region shrinks by one row per step at non-global edges
+            for (int s = 0; s < k; ++s) {
+                const int64_t lo = (a == 0) ? 0 : a + s + 1;
+                const int64_t hi = (e == nx) ? nx : e - s - 1;
+                {
+                    ScopedSpan span(compute_ring, kPhaseUpdate, t + s);
+                    for (int64_t i = lo; i < hi; ++i) {
+                        const double* c = vi_b + (i - a) * ny;
+                        stencil_row(i, nx, ny, i > 0 ? c - ny : nullptr, c, i + 1 < nx ? c + ny : nullptr,
+                                    &vr_buf[(i - a) * ny]);
+                    }
+                }
+                {
+                    ScopedSpan span(compute_ring, kPhaseScan, t + s);
+                    for (int64_t i = max(lo, r0); i < min(hi, r1); ++i) {
+                        scan_row(step_hits[s].items(), i, ny, vi_b + (i - a) * ny, &vr_buf[(i - a) * ny]);
+                    }
+                }
+                ScopedSpan span(compute_ring, kPhaseAverage, t + s);
+                for (int64_t idx = (lo - a) * ny; idx < (hi - a) * ny; ++idx) {
+                    vi_b[idx] = (vi_b[idx] + vr_buf[idx]) * half;
+                }
+            }
+
+            // write behind rows [r0, r1), now at time t + k
+            {
+                ScopedSpan span(compute_ring, kPhaseWait, t);
+                writer_pool.wait();
+            }
+            write_r0 = r0;
+            write_r1 = r1;
+            write_a = a;
+            write_src = vi_b;
+            writer_pool.start(write_task);
+            bytes_written += (r1 - r0) * ny * static_cast<int64_t>(sizeof(double));
+            swap(halo_in, halo_out);
+            cur = next;
+        }
+        {
+            ScopedSpan span(compute_ring, kPhaseWait, t);
+            writer_pool.wait();
+        }
+        writer.flush();
+        STENCIL_PROBE2(io_flush, t, bytes_written);
+        {
+            ScopedSpan span(compute_ring, kPhaseOutput, t);
+            for (int s = 0; s < k; ++s) write_hits(fout, t + s, step_hits[s].items());
+        }
+        alloc_stats.end_step();
+        STENCIL_PROBE2(pass_end, t, k);
+    }
+    auto t_end = std::chrono::high_resolution_clock::now();
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(t_end - t_start).count();
+    const double seconds = chrono::duration<double>(t_end - t_start).count();
+    const double cells = static_cast<double>(nx) * ny * nt;
+    cout << "\n[chrono] time_ms=" << elapsed_ms << "\n";
+    auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count();
+    cout << "[chrono] time_us=" << elapsed_us << "\n";
+    cout << "[ooc] cells_per_s=" << cells / seconds << " bytes_read=" << bytes_read
+         << " bytes_written=" << bytes_written << "\n";
+    alloc_stats.report(cout, "pass");
+    report_step_buffers(cout, step_hits.get(), tblock);
+    report_memory(cout);
+    alloc_stats.warn_steady(cerr, "pass");
+
+    if (compare) {
+        fout.flush();
+        const string unique = to_string(chrono::steady_clock::now().time_since_epoch().count());
+        const filesystem::path dir = filesystem::temp_directory_path() / ("ooc_compare_" + unique);
+        filesystem::create_directories(dir);
+        const double ref_us = run_reference(argv[0], dir, nx, ny, nt);
+        GridDump ref;
+        bool same_grid = ref_us >= 0.0 && read_grid_dump((dir / "reference.grid").string(), ref) &&
+                         ref.nx == nx && ref.ny == ny;
+        vector<double> row(ny);
+        for (int64_t i = 0; same_grid && i < nx; ++i) {
+            reader.read_rows(i, 1, row.data());
+            same_grid = memcmp(row.data(), &ref.values[i * ny], ny * sizeof(double)) == 0;
+        }
+        const bool same_out = ref_us >= 0.0 && same_hits("data_out", (dir / "data_out").string());
+        error_code ec;
+        filesystem::remove_all(dir, ec);
+        cout << "[ooc] optimized_cells_per_s=" << cells / max(ref_us * 1e-6, 1e-12)
+             << " ratio=" << (cells / seconds) / (cells / max(ref_us * 1e-6, 1e-12))
+             << " final_grid_matches=" << (same_grid ? "yes" : "no") << " hits_match=" << (same_out ? "yes" : "no")
+             << "\n";
+    }
+    if (!opt.trace.empty()) {
+        const TraceTrack tracks[] = {{"compute", -1, &compute_ring}, {"reader", -1, &read_ring},
+                                     {"writer", -1, &write_ring}};
+        if (write_chrome_trace(opt.trace, "out_of_core", tracks, 3)) cout << "[trace] wrote " << opt.trace << "\n";
+    }
+    if (!opt.dump_grid.empty()) {
+        // the final state is the grid file; one row at a time is read back
+        vector<double> row(ny);
+        int64_t loaded = -1;
+        write_grid_dump(opt.dump_grid, nx, ny, [&](long long i, long long j) {
+            if (i != loaded) reader.read_rows(loaded = i, 1, row.data());
+            return row[j];
+        });
+    }
+    if (!keep_file) remove(grid_path.c_str());
+    return 0;
+}
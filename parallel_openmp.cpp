@@ -7,6 +7,24 @@ OpenMP directives explained:
 - #pragma omp parallel for schedule(static) : Divides loop iterations among threads evenly with minimal overhead.
 - collapse(2) on nested loops: Flattens two loops into one iteration space to improve load balancing across threads.
 - reduction, private/shared: Not required here (each iteration writes a unique element), but critical for dependent patterns.
+
+For grids beyond the last-level cache the interior update writes vr with streaming stores (--nt-stores); the
+OpenMP version then distributes whole rows so each thread runs the vectorised segment kernel of stencil_kernels.hpp.
+The same row-wise path is used with software prefetching (--prefetch=D|auto): with many threads each streaming its own
+row range the hardware prefetchers run out of tracked streams, so rows a few ahead are requested explicitly.
+--threads=N sets the worker count (OpenMP and fallback alike) so both can be benchmarked across thread counts.
+
+The threshold scan runs in parallel too: each thread appends its hits to its own buffer (step_arena.hpp, reset every
+step) and the buffers are written in thread order, which is row order. The fallback keeps one WorkerPool for the
+whole run instead of spawning threads every step, so the steady-state timestep makes no heap allocations
+(checked with alloc_counter.hpp).
+
+For tall grids (nx >> ny, e.g. the default 10000 x 200) the grid is stored transposed (--transpose=auto|on|off) so
+each thread works on long contiguous rows instead of 198-element ones; boundaries use original coordinates and the
+hits are sorted back to (i, j) order, so the output does not change.
+
+Startup: --prefault=parallel initialises the grid with all threads (each first-touches the rows it later updates),
+--prefault=populate maps it with MAP_POPULATE; time to the first timestep and page faults are reported.
 */
 #include <iostream>
 #include <fstream>
@@ -15,136 +33,410 @@ OpenMP directives explained:
 #include <vector>
 #include <thread>
 #include <algorithm>
+#include <memory>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
+#include "alloc_counter.hpp"
+#include "grid_dump.hpp"
+#include "machine_probe.hpp"
+#include "memory_report.hpp"
+#include "perf_counters.hpp"
+#include "phase_timer.hpp"
+#include "roofline.hpp"
+#include "stencil_grid.hpp"
+#include "stencil_kernels.hpp"
+#include "stencil_options.hpp"
+#include "step_arena.hpp"
+#include "step_latency.hpp"
+#include "trace_export.hpp"
+#include "usdt_probes.hpp"
+#include "worker_pool.hpp"
 
 using namespace std;
 
-static inline void stencil_update_block(
-    const double* vi, double* vr, int nx, int ny, int i_begin, int i_end)
+// The helpers below work in storage coordinates: `rows` x `cols` is nx x ny, or ny x nx when the grid is stored
+// transposed (--transpose). Transposed rows pass their neighbours in the original order (i+1, i-1, j-1, j+1).
+
+// Interior of storage row i through the segment kernels; pf > 0 prefetches vi row i+1+pf and vr row i+pf.
+static inline void stencil_update_row(
+    const double* vi, double* vr, int rows, int cols, size_t stride, int i, bool nt, int pf, bool transposed)
+{
+    const double* pf_vi = pf > 0 && i + 1 + pf < rows ? vi + (i + 1 + pf) * stride : nullptr;
+    double* pf_vr = pf > 0 && i + pf < rows ? vr + (i + pf) * stride : nullptr;
+    const double* up = vi + (i - 1) * stride;
+    const double* c = vi + i * stride;
+    const double* dn = vi + (i + 1) * stride;
+    const double *a = dn, *b = up, *l = c - 1, *r = c + 1;
+    if (transposed) {
+        a = c + 1;
+        b = c - 1;
+        l = up;
+        r = dn;
+    }
+    if (nt) sum4_segment_nt(a, b, l, r, vr + i * stride, 1, cols - 1, 0.25, pf_vi);
+    else sum4_segment_pf(a, b, l, r, vr + i * stride, 1, cols - 1, 0.25, pf_vi, pf_vr);
+}
+
+static inline void stencil_update_block(const double* vi, double* vr, int rows, int cols, size_t stride,
+                                        int i_begin, int i_end, bool nt, int pf, bool transposed)
 {
-    // Update interior for rows [i_begin, i_end) (excludes boundary rows 0 and nx-1)
-    for (int i = max(1, i_begin); i < min(nx - 1, i_end); ++i) {
-        for (int j = 1; j < ny - 1; ++j) {
-            vr[i * ny + j] = (vi[(i + 1) * ny + j] + vi[(i - 1) * ny + j] +
-                              vi[i * ny + (j - 1)] + vi[i * ny + (j + 1)]) * 0.25;
+    // Update interior for rows [i_begin, i_end) (excludes boundary rows 0 and rows-1)
+    for (int i = max(1, i_begin); i < min(rows - 1, i_end); ++i) {
+        if (nt || pf > 0 || transposed) {
+            stencil_update_row(vi, vr, rows, cols, stride, i, nt, pf, transposed);
+            continue;
+        }
+        for (int j = 1; j < cols - 1; ++j) {
+            vr[i * stride + j] = (vi[(i + 1) * stride + j] + vi[(i - 1) * stride + j] +
+                                  vi[i * stride + (j - 1)] + vi[i * stride + (j + 1)]) * 0.25;
+        }
+    }
+    if (nt) stream_fence();
+}
+
+// Threshold scan of storage rows [i_begin, i_end) into a per-thread hit buffer (original i, j);
+// pf > 0 prefetches rows pf ahead.
+static inline void scan_block(const double* vi, const double* vr, int rows, int cols, size_t stride,
+                              int i_begin, int i_end, int pf, bool transposed, std::pmr::vector<StencilHit>& hits)
+{
+    for (int i = i_begin; i < i_end; ++i) {
+        const bool pf_row = pf > 0 && i + pf < rows;
+        for (int j = 0; j < cols; ++j) {
+            if (pf_row && (j & 7) == 0) {
+                __builtin_prefetch(vi + (i + pf) * stride + j, 0, 3);
+                __builtin_prefetch(vr + (i + pf) * stride + j, 0, 3);
+            }
+            if (fabs(fabs(vr[i * stride + j]) - fabs(vi[i * stride + j])) < 1e-2) {
+                if (transposed) hits.push_back({j, i, fabs(vi[i * stride + j]), fabs(vr[i * stride + j])});
+                else hits.push_back({i, j, fabs(vi[i * stride + j]), fabs(vr[i * stride + j])});
+            }
         }
     }
 }
 
 int main(int argc, char* argv[]) {
-    int nx = 10000;
-    int ny = 200;
-    int nt = 200;
+    StartupProbe startup; // first: everything up to the first timestep counts as startup
     const double quarter = 0.25;
     const double half = 0.5;
     const double pi = 4.0 * atan(1.0);
 
-    // Optional CLI: nx ny nt
-    if (argc >= 4) {
-        nx = atoi(argv[1]);
-        ny = atoi(argv[2]);
-        nt = atoi(argv[3]);
+    // Optional CLI: nx ny nt [--pad=auto|off|lines] [--nt-stores=auto|on|off|compare] [--prefetch=D|auto]
+    //               [--threads=N] [--transpose=auto|on|off] [--prefault=none|populate|parallel] [--roofline[=csv]]
+    //               [--perf] [--dump-grid=path] [--trace=path.json]
+    //               [--latency-hist=path.hgrm] [--quiet]
+    StencilOptions opt;
+    if (!parse_stencil_options(argc, argv, opt)) return 1;
+    if (opt.layout != GridLayout::RowMajor) {
+        cerr << "This engine only supports --layout=row (tiled layouts live in cache_optimized).\n";
+        return 1;
     }
+    if (!supports_stencil_flags(opt, kAllStencilFlags & ~kFlagFields, argv[0])) return 1;
+    const int nx = opt.nx, ny = opt.ny, nt = opt.nt;
+    const bool transposed = use_transposed_storage(opt);
+#ifdef _OPENMP
+    if (opt.threads > 0) omp_set_num_threads(opt.threads);
+    const int num_threads = omp_get_max_threads();
+#else
+    const int num_threads = opt.threads > 0 ? opt.threads
+                                            : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    WorkerPool pool(num_threads); // started once; every parallel phase below is one dispatch
+    // static row partition of [first, last) for worker tid (the last worker takes the remainder)
+    auto block_of = [&](int tid, int first, int last, int& begin, int& end) {
+        const int chunk = max(1, (last - first) / num_threads);
+        begin = first + tid * chunk;
+        end = (tid == num_threads - 1) ? last : min(last, begin + chunk);
+    };
+#endif
+    auto hit_buffers = make_unique<StepBuffer<StencilHit>[]>(num_threads);
+    // per-thread spans of the parallel phases (phase_timer.hpp), tagged with the timestep (-1 while tuning)
+    auto phase_rings = make_unique<PhaseRing[]>(num_threads);
+    const size_t ring_capacity = opt.trace.empty() ? kPhaseRingCapacity : kTraceRingCapacity;
+    for (int tid = 0; tid < num_threads; ++tid) phase_rings[tid].reset(ring_capacity, tid);
+    int span_step = -1;
+
+    // Padded, skewed row stride (see stencil_grid.hpp); element (i, j) lives at i * stride + j, or at j * stride + i
+    // when stored transposed (storage is then ny rows of nx, so the long axis is the contiguous one)
+    StencilGrid grid(transposed ? ny : nx, transposed ? nx : ny, opt.pad_lines, GridLayout::RowMajor, 64, true,
+                     opt.prefault == StencilOptions::Prefault::Populate);
+    double* vi = grid.vi;
+    double* vr = grid.vr;
+    const size_t stride = grid.stride;
+    const int rows = grid.nx, cols = grid.ny;
+    auto at = [&](int i, int j) { return transposed ? j * stride + i : i * stride + j; };
 
-    vector<double> vi(nx * ny), vr(nx * ny);
+    PhaseTimer timer(ring_capacity);
+    timer.begin(kPhaseInit);
 
-    // Initialize (row-major, cache-friendly)
+    // Initialize in storage order; i*i and sin(pi/nx*i) are computed once per grid row i.
+    // With --prefault=parallel every thread initialises, and so first-touches, the storage rows it later updates.
+    vector<double> i_sq(nx), i_factor(nx);
     for (int i = 0; i < nx; ++i) {
-        double i_sq = 1.0 * i * i;
-        double i_factor = sin(pi / nx * i);
-        for (int j = 0; j < ny; ++j) {
-            vi[i * ny + j] = i_sq * j * i_factor;
-            vr[i * ny + j] = 0.0;
+        i_sq[i] = 1.0 * i * i;
+        i_factor[i] = sin(pi / nx * i);
+    }
+    auto init_rows = [&](int r_begin, int r_end) {
+        for (int r = r_begin; r < r_end; ++r) {
+            for (int c = 0; c < cols; ++c) {
+                const int i = transposed ? c : r, j = transposed ? r : c;
+                vi[r * stride + c] = i_sq[i] * j * i_factor[i];
+                vr[r * stride + c] = 0.0;
+            }
         }
+    };
+    if (opt.prefault == StencilOptions::Prefault::Parallel) {
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+        for (int r = 0; r < rows; ++r) init_rows(r, r + 1);
+#else
+        auto init_task = [&](int tid) {
+            int r_begin, r_end;
+            block_of(tid, 0, rows, r_begin, r_end);
+            init_rows(r_begin, r_end);
+        };
+        pool.run(init_task);
+#endif
+    } else {
+        init_rows(0, rows);
     }
+    timer.end(kPhaseInit);
 
-    ofstream fout("data_out");
+    auto fout = make_tracked<ofstream>(kMemOutput, "data_out");
     if (!fout) {
         cerr << "Error opening output file.\n";
         return 1;
     }
 
-    auto t_start = std::chrono::high_resolution_clock::now();
-    for (int t = 0; t < nt; ++t) {
-        cout << "\n" << t; cout.flush();
+    // Streaming stores for vr once vi + vr no longer fit in the last-level cache
+    const CacheSizes caches = detect_cache_sizes();
+    const size_t working_set = 2 * grid.field_bytes();
+    const bool use_nt = opt.nt_stores == StencilOptions::NtStores::On ||
+                        (opt.nt_stores != StencilOptions::NtStores::Off && working_set > caches.llc);
 
+    auto update_interior = [&](bool nt, int pf) {
 #ifdef _OPENMP
+        if (nt || pf > 0 || transposed) {
+            // Interior update with streaming stores, prefetching or transposed storage: whole rows per thread so the
+            // segment kernel can vectorise; every thread fences its own streaming stores before the closing barrier
+            #pragma omp parallel
+            {
+                ScopedSpan span(phase_rings[omp_get_thread_num()], kPhaseUpdate, span_step);
+                #pragma omp for schedule(static) nowait
+                for (int i = 1; i < rows - 1; ++i) {
+                    stencil_update_row(vi, vr, rows, cols, stride, i, nt, pf, transposed);
+                }
+                if (nt) stream_fence();
+            }
+            return;
+        }
         // Interior update (OpenMP)
         // Parallelize nested loops; each thread writes to a unique (i,j) element.
-        #pragma omp parallel for collapse(2) schedule(static)
-        for (int i = 1; i < nx - 1; ++i) {
-            for (int j = 1; j < ny - 1; ++j) {
-                vr[i * ny + j] = (vi[(i + 1) * ny + j] + vi[(i - 1) * ny + j] +
-                                  vi[i * ny + (j - 1)] + vi[i * ny + (j + 1)]) * quarter;
+        #pragma omp parallel
+        {
+            ScopedSpan span(phase_rings[omp_get_thread_num()], kPhaseUpdate, span_step);
+            #pragma omp for collapse(2) schedule(static) nowait
+            for (int i = 1; i < nx - 1; ++i) {
+                for (int j = 1; j < ny - 1; ++j) {
+                    vr[i * stride + j] = (vi[(i + 1) * stride + j] + vi[(i - 1) * stride + j] +
+                                          vi[i * stride + (j - 1)] + vi[i * stride + (j + 1)]) * quarter;
+                }
             }
         }
 #else
-        // Interior update (std::thread fallback)
-        const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
-        const int num_threads = static_cast<int>(hw);
-        vector<thread> threads;
-        threads.reserve(num_threads);
-        int rows = nx - 2; // interior rows [1, nx-2]
-        int chunk = max(1, rows / num_threads);
-        for (int tid = 0; tid < num_threads; ++tid) {
-            int i_begin = 1 + tid * chunk;
-            int i_end = (tid == num_threads - 1) ? (nx - 1) : min(nx - 1, i_begin + chunk);
-            threads.emplace_back(stencil_update_block, vi.data(), vr.data(), nx, ny, i_begin, i_end);
-        }
-        for (auto& th : threads) th.join();
+        // Interior update (std::thread fallback): interior rows [1, nx-2] split across the pool
+        auto task = [&](int tid) {
+            ScopedSpan span(phase_rings[tid], kPhaseUpdate, span_step);
+            int i_begin, i_end;
+            block_of(tid, 1, rows - 1, i_begin, i_end);
+            stencil_update_block(vi, vr, rows, cols, stride, i_begin, i_end, nt, pf, transposed);
+        };
+        pool.run(task);
 #endif
+    };
 
-        // Boundaries (serial; small cost, keeps logic simple)
-        for (int j = 1; j < ny - 1; ++j) {
-            vr[0 * ny + j] = (vi[1 * ny + j] + 10.0 + vi[0 * ny + (j - 1)] + vi[0 * ny + (j + 1)]) * quarter;
-            vr[(nx - 1) * ny + j] = (5.0 + vi[(nx - 2) * ny + j] +
-                                     vi[(nx - 1) * ny + (j - 1)] + vi[(nx - 1) * ny + (j + 1)]) * quarter;
+    const int prefetch = opt.prefetch >= 0 ? opt.prefetch
+                                           : tune_prefetch_distance([&](int d) { update_interior(use_nt, d); }, cout);
+
+    // hardware counters per phase (--perf): one group per thread, summed at the timer's phase boundaries
+#ifdef _OPENMP
+    PerfCounters perf(opt.perf, num_threads, nt);
+    #pragma omp parallel if (opt.perf)
+    perf.open_thread(omp_get_thread_num());
+#else
+    PerfCounters perf(opt.perf, num_threads + 1, nt); // the workers, then the main thread (boundaries, output)
+    auto open_task = [&](int tid) { perf.open_thread(tid); };
+    if (opt.perf) pool.run(open_task);
+    perf.open_thread(num_threads);
+#endif
+    if (perf.active()) timer.observe(&perf);
+    StepAllocStats alloc_stats;
+    StepLatency latency(timer); // wall time of every step, HDR histogram (step_latency.hpp); calibrates the TSC
+    startup.first_step();       // after the calibration spin, which is startup work too
+    auto t_start = std::chrono::high_resolution_clock::now();
+    for (int t = 0; t < nt; ++t) {
+        latency.begin_step(t);
+        STENCIL_PROBE1(step_begin, t);
+        for (int tid = 0; tid < num_threads; ++tid) hit_buffers[tid].reset(); // growth: see [arena] growths
+        alloc_stats.begin_step();
+        if (!opt.quiet) { cout << "\n" << t; cout.flush(); }
+        timer.set_step(t);
+        span_step = t;
+
+        timer.begin(kPhaseUpdate);
+        update_interior(use_nt, prefetch);
+        timer.end(kPhaseUpdate);
+
+        // Boundaries (serial; small cost, keeps logic simple), addressed in original coordinates.
+        // One-cell-wide grids have no updated boundary (as in the baseline): rows need nx > 1, columns ny > 1.
+        timer.begin(kPhaseBoundaries);
+        for (int j = 1; nx > 1 && j < ny - 1; ++j) {
+            vr[at(0, j)] = (vi[at(1, j)] + 10.0 + vi[at(0, j - 1)] + vi[at(0, j + 1)]) * quarter;
+            vr[at(nx - 1, j)] = (5.0 + vi[at(nx - 2, j)] + vi[at(nx - 1, j - 1)] + vi[at(nx - 1, j + 1)]) * quarter;
         }
-        for (int i = 1; i < nx - 1; ++i) {
-            vr[i * ny + 0] = (vi[(i + 1) * ny + 0] + vi[(i - 1) * ny + 0] + 15.45 + vi[i * ny + 1]) * quarter;
-            vr[i * ny + (ny - 1)] = (vi[(i + 1) * ny + (ny - 1)] + vi[(i - 1) * ny + (ny - 1)] +
-                                     vi[i * ny + (ny - 2)] - 6.7) * quarter;
+        for (int i = 1; ny > 1 && i < nx - 1; ++i) {
+            vr[at(i, 0)] = (vi[at(i + 1, 0)] + vi[at(i - 1, 0)] + 15.45 + vi[at(i, 1)]) * quarter;
+            vr[at(i, ny - 1)] = (vi[at(i + 1, ny - 1)] + vi[at(i - 1, ny - 1)] + vi[at(i, ny - 2)] - 6.7) * quarter;
         }
+        timer.end(kPhaseBoundaries);
 
-        // Conditional output (serial)
-        for (int i = 0; i < nx; ++i) {
-            for (int j = 0; j < ny; ++j) {
-                if (fabs(fabs(vr[i * ny + j]) - fabs(vi[i * ny + j])) < 1e-2) {
-                    fout << t << " " << i << " " << j << " "
-                         << fabs(vi[i * ny + j]) << " " << fabs(vr[i * ny + j]) << "\n";
-                }
+        // Conditional output: parallel scan into per-thread buffers, written in row order afterwards
+        timer.begin(kPhaseScan);
+#ifdef _OPENMP
+        #pragma omp parallel
+        {
+            ScopedSpan span(phase_rings[omp_get_thread_num()], kPhaseScan, span_step);
+            std::pmr::vector<StencilHit>& hits = hit_buffers[omp_get_thread_num()].items();
+            const int tid = omp_get_thread_num(), team = omp_get_num_threads();
+            // same split as schedule(static): thread tid scans one contiguous block of rows, in thread order
+            const int chunk = rows / team, extra = rows % team;
+            const int i_begin = tid * chunk + min(tid, extra);
+            scan_block(vi, vr, rows, cols, stride, i_begin, i_begin + chunk + (tid < extra ? 1 : 0), prefetch,
+                       transposed, hits);
+        }
+#else
+        auto scan_task = [&](int tid) {
+            ScopedSpan span(phase_rings[tid], kPhaseScan, span_step);
+            int i_begin, i_end;
+            block_of(tid, 0, rows, i_begin, i_end);
+            scan_block(vi, vr, rows, cols, stride, i_begin, i_end, prefetch, transposed, hit_buffers[tid].items());
+        };
+        pool.run(scan_task);
+#endif
+        timer.end(kPhaseScan);
+        timer.begin(kPhaseOutput);
+        if (transposed) {
+            // hits came out column by column of the grid: gather them and restore the (i, j) order
+            std::pmr::vector<StencilHit>& all = hit_buffers[0].items();
+            for (int tid = 1; tid < num_threads; ++tid) {
+                all.insert(all.end(), hit_buffers[tid].items().begin(), hit_buffers[tid].items().end());
             }
+            sort(all.begin(), all.end(), [](const StencilHit& x, const StencilHit& y) {
+                return x.i != y.i ? x.i < y.i : x.j < y.j;
+            });
+            write_hits(fout, t, all);
+        } else {
+            for (int tid = 0; tid < num_threads; ++tid) write_hits(fout, t, hit_buffers[tid].items());
         }
+        timer.end(kPhaseOutput);
 
-        // Average update vi = (vi + vr)/2
+        // Average update vi = (vi + vr)/2, row by row (padding between rows is skipped)
+        timer.begin(kPhaseAverage);
 #ifdef _OPENMP
-        #pragma omp parallel for schedule(static)
-        for (int idx = 0; idx < nx * ny; ++idx) {
-            vi[idx] = (vi[idx] + vr[idx]) * half;
+        #pragma omp parallel
+        {
+            ScopedSpan span(phase_rings[omp_get_thread_num()], kPhaseAverage, span_step);
+            #pragma omp for schedule(static) nowait
+            for (int i = 0; i < rows; ++i) {
+                for (int j = 0; j < cols; ++j) {
+                    vi[i * stride + j] = (vi[i * stride + j] + vr[i * stride + j]) * half;
+                }
+            }
         }
 #else
-        const unsigned hw2 = std::max(1u, std::thread::hardware_concurrency());
-        const int num_threads2 = static_cast<int>(hw2);
-        vector<thread> threads2;
-        threads2.reserve(num_threads2);
-        int total = nx * ny;
-        int block = max(1, total / num_threads2);
-        auto avg_block = [&](int begin, int end){
-            for (int k = begin; k < end; ++k) vi[k] = (vi[k] + vr[k]) * half;
+        auto avg_task = [&](int tid) {
+            ScopedSpan span(phase_rings[tid], kPhaseAverage, span_step);
+            int begin, end;
+            block_of(tid, 0, rows, begin, end);
+            for (int i = begin; i < end; ++i) {
+                for (int j = 0; j < cols; ++j) {
+                    vi[i * stride + j] = (vi[i * stride + j] + vr[i * stride + j]) * half;
+                }
+            }
         };
-        for (int tid = 0; tid < num_threads2; ++tid) {
-            int begin = tid * block;
-            int end = (tid == num_threads2 - 1) ? total : min(total, begin + block);
-            threads2.emplace_back(avg_block, begin, end);
-        }
-        for (auto& th : threads2) th.join();
+        pool.run(avg_task);
 #endif
+        timer.end(kPhaseAverage);
+        perf.end_step();
+        alloc_stats.end_step();
+        STENCIL_PROBE1(step_end, t);
+        latency.end_step();
     }
     auto t_end = std::chrono::high_resolution_clock::now();
+    span_step = -1;
     auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(t_end - t_start).count();
     cout << "\n[chrono] time_ms=" << elapsed_ms << "\n";
+    auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count();
+    cout << "[chrono] time_us=" << elapsed_us << "\n";
+    startup.report(cout, prefault_name(opt.prefault));
+
+    // Effective bandwidth of the update: one read of vi and one write of vr per interior cell
+    const double update_bytes = 2.0 * sizeof(double) * max(0, nx - 2) * max(0, ny - 2);
+    cout << "[bw] update_GBps=" << update_bytes * nt / max(timer.seconds(kPhaseUpdate), 1e-12) * 1e-9
+         << " nt_stores=" << (use_nt ? "on" : "off") << " prefetch=" << prefetch << " threads=" << num_threads
+         << " transposed=" << (transposed ? "yes" : "no")
+         << " working_set=" << working_set
+         << " llc_bytes=" << caches.llc << " (" << caches.source << ")\n";
+    cout << "[phases]";
+    for (Phase phase : {kPhaseUpdate, kPhaseBoundaries, kPhaseScan, kPhaseOutput, kPhaseAverage}) {
+        cout << " " << phase_name(phase) << "_ms=" << timer.seconds(phase) * 1e3;
+    }
+    cout << "\n";
+    double phase_cells[kPhaseCount];
+    stencil_phase_cells(nx, ny, phase_cells);
+    timer.report(cout, phase_cells, nt);
+    latency.report(cout, nt);
+    if (!opt.latency_hist.empty() && latency.write_hgrm(opt.latency_hist)) {
+        cout << "[latency] wrote " << opt.latency_hist << "\n";
+    }
+    report_worker_rings(cout, phase_rings.get(), num_threads, phase_cells, nt);
+    report_imbalance(cout, phase_rings.get(), num_threads, timer.ring());
+    perf.report(cout, static_cast<double>(nx) * ny);
+    if (opt.roofline) {
+        const MachinePeaks peaks = measure_peaks(caches, num_threads, working_set);
+        vector<RooflineRow> roofline_rows;
+        for (Phase phase : {kPhaseUpdate, kPhaseBoundaries, kPhaseScan, kPhaseAverage}) {
+            roofline_rows.push_back({phase, phase_cost(phase, nx, ny, nt, !use_nt), timer.seconds(phase)});
+        }
+        report_roofline(cout, "parallel_openmp", peaks, roofline_rows, opt.roofline_csv);
+    }
+    if (opt.nt_stores == StencilOptions::NtStores::Compare) {
+        // The update only reads vi and writes vr, so it can be repeated on the final state for a side-by-side
+        for (bool nt_variant : {false, true}) {
+            const int reps = 5;
+            auto t0 = std::chrono::steady_clock::now();
+            for (int r = 0; r < reps; ++r) update_interior(nt_variant, prefetch);
+            const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            cout << "[bw] compare nt_stores=" << (nt_variant ? "on" : "off")
+                 << " update_GBps=" << update_bytes * reps / max(s, 1e-12) * 1e-9 << "\n";
+        }
+    }
+
+    alloc_stats.report(cout);
+    report_step_buffers(cout, hit_buffers.get(), num_threads);
+    report_memory(cout);
+    alloc_stats.warn_steady(cerr);
+    if (!opt.trace.empty()) {
+        // the main thread's phases, then every worker with its barrier waits against them
+        auto tracks = make_unique<TraceTrack[]>(num_threads + 1);
+        tracks[0] = {"main", -1, &timer.ring()};
+        for (int tid = 0; tid < num_threads; ++tid) tracks[tid + 1] = {"worker", tid, &phase_rings[tid], &timer.ring()};
+        if (write_chrome_trace(opt.trace, "parallel_openmp", tracks.get(), num_threads + 1)) {
+            cout << "[trace] wrote " << opt.trace << "\n";
+        }
+    }
+    if (!opt.dump_grid.empty()) {
+        write_grid_dump(opt.dump_grid, nx, ny, [&](long long i, long long j) { return vi[at(i, j)]; });
+    }
 
     return 0;
 }
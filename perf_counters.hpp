@@ -0,0 +1,275 @@
+/*
+High-Performance C++: Hardware performance counters per timestep phase (Linux perf_event_open)
+Purpose: Back the cache-locality claims with counts instead of wall time alone: cycles, instructions, L1D, LLC and
+         dTLB read misses and back-end (memory) stall cycles per phase, summed over every thread that works on it.
+Key ideas: Each worker thread opens one counter group for itself; the phase boundaries are read by the main thread
+           while the workers are idle, so every phase sees the sum over all groups. The group leader is the software
+           task clock, which exists everywhere perf exists, and every hardware event joins the group only if the host
+           has it: in containers and VMs without a PMU, or with a restrictive perf_event_paranoid, the report shows
+           what was available (at least task clock and page faults) and names what was not. Counts are scaled by
+           time_enabled / time_running when the kernel multiplexes the group. Only user-space events are counted.
+           PhaseTimer drives the reads (PhaseObserver), so the engines only open the groups and report.
+Notes: Per-step values of the first kPerfStepCap steps are kept (preallocated) for min / median / max per phase.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "phase_timer.hpp"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/perf_event.h>)
+#define STENCIL_HAVE_PERF 1
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
+
+enum PerfEvent {
+    kPerfTaskClock,
+    kPerfCycles,
+    kPerfInstructions,
+    kPerfL1dMisses,
+    kPerfLlcMisses,
+    kPerfDtlbMisses,
+    kPerfStallsBackend,
+    kPerfPageFaults,
+    kPerfEventCount
+};
+
+inline const char* perf_event_name(int event) {
+    static const char* const names[kPerfEventCount] = {"task_clock_ns", "cycles",      "instructions",
+                                                       "l1d_misses",    "llc_misses",  "dtlb_misses",
+                                                       "stalls_mem",    "page_faults"};
+    return names[event];
+}
+
+struct PerfSample {
+    std::uint64_t v[kPerfEventCount] = {};
+};
+
+// One counter group counting the thread that opened it.
+class PerfGroup {
+public:
+    PerfGroup() { std::fill(slot_, slot_ + kPerfEventCount, -1); }
+    ~PerfGroup() { close_all(); }
+    PerfGroup(const PerfGroup&) = delete;
+    PerfGroup& operator=(const PerfGroup&) = delete;
+
+    // Opens the group for the calling thread; false (with the reason) when not even the leader opens.
+    bool open(std::string& error) {
+#ifdef STENCIL_HAVE_PERF
+        for (int event = 0; event < kPerfEventCount; ++event) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            describe(event, attr);
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.disabled = leader_ < 0 ? 1 : 0;
+            const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader_, 0));
+            if (fd < 0) {
+                if (error.empty()) error = std::string(perf_event_name(event)) + ": " + std::strerror(errno);
+                if (leader_ < 0) return false;
+                continue;
+            }
+            if (leader_ < 0) leader_ = fd;
+            fds_[members_] = fd;
+            slot_[event] = members_++;
+        }
+        ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+#else
+        error = "perf_event_open is not available on this platform";
+        return false;
+#endif
+    }
+
+    bool is_open() const { return leader_ >= 0; }
+    bool has(int event) const { return slot_[event] >= 0; }
+
+    // Adds the current (multiplexing-scaled) counts to acc.
+    void read_into(PerfSample& acc) const {
+#ifdef STENCIL_HAVE_PERF
+        if (leader_ < 0) return;
+        std::uint64_t buf[3 + kPerfEventCount];
+        if (::read(leader_, buf, sizeof(buf)) < static_cast<ssize_t>(3 * sizeof(std::uint64_t))) return;
+        const double scale = buf[2] ? static_cast<double>(buf[1]) / static_cast<double>(buf[2]) : 0.0;
+        for (int event = 0; event < kPerfEventCount; ++event) {
+            if (slot_[event] >= 0 && static_cast<std::uint64_t>(slot_[event]) < buf[0]) {
+                acc.v[event] += static_cast<std::uint64_t>(static_cast<double>(buf[3 + slot_[event]]) * scale);
+            }
+        }
+#else
+        (void)acc;
+#endif
+    }
+
+private:
+#ifdef STENCIL_HAVE_PERF
+    static void describe(int event, perf_event_attr& attr) {
+        const auto cache_miss = [](std::uint64_t cache) {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        };
+        switch (event) {
+        case kPerfTaskClock: attr.type = PERF_TYPE_SOFTWARE; attr.config = PERF_COUNT_SW_TASK_CLOCK; break;
+        case kPerfCycles: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case kPerfInstructions: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case kPerfL1dMisses: attr.type = PERF_TYPE_HW_CACHE; attr.config = cache_miss(PERF_COUNT_HW_CACHE_L1D); break;
+        case kPerfLlcMisses: attr.type = PERF_TYPE_HW_CACHE; attr.config = cache_miss(PERF_COUNT_HW_CACHE_LL); break;
+        case kPerfDtlbMisses: attr.type = PERF_TYPE_HW_CACHE; attr.config = cache_miss(PERF_COUNT_HW_CACHE_DTLB); break;
+        case kPerfStallsBackend:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_STALLED_CYCLES_BACKEND;
+            break;
+        default: attr.type = PERF_TYPE_SOFTWARE; attr.config = PERF_COUNT_SW_PAGE_FAULTS; break;
+        }
+    }
+#endif
+
+    void close_all() {
+#ifdef STENCIL_HAVE_PERF
+        for (int m = 0; m < members_; ++m) close(fds_[m]);
+#endif
+        members_ = 0;
+        leader_ = -1;
+    }
+
+    int leader_ = -1;
+    int members_ = 0;
+    int fds_[kPerfEventCount] = {};
+    int slot_[kPerfEventCount]; // position of each event in the group read, -1 = not counted
+};
+
+constexpr int kPerfStepCap = 10000;
+
+// Counter groups of all threads of a run, read at every phase boundary of the PhaseTimer it observes.
+class PerfCounters : public PhaseObserver {
+public:
+    // slots: number of threads that will call open_thread (each with its own slot)
+    PerfCounters(bool enabled, int slots, int nt)
+        : enabled_(enabled), slots_(slots), groups_(enabled ? std::make_unique<PerfGroup[]>(slots) : nullptr) {
+        if (!enabled_) return;
+        steps_.reserve(static_cast<std::size_t>(std::min(nt, kPerfStepCap)) * kPhaseCount);
+        sorted_.resize(std::min(nt, kPerfStepCap));
+    }
+
+    // Call on the thread that will use `slot`; distinct slots may be opened concurrently.
+    void open_thread(int slot) {
+        if (!enabled_) return;
+        std::string error;
+        if (!groups_[slot].open(error) && slot == 0) error_ = error;
+        if (slot == 0 && !error.empty() && missing_.empty()) missing_ = error;
+    }
+
+    // True when the calling engine should attach this to its PhaseTimer.
+    bool active() const { return enabled_ && groups_[0].is_open(); }
+
+    void phase_begin(Phase phase) override { sample(start_[phase]); }
+    void phase_end(Phase phase) override {
+        PerfSample now;
+        sample(now);
+        for (int e = 0; e < kPerfEventCount; ++e) step_[phase].v[e] += now.v[e] - start_[phase].v[e];
+    }
+
+    // Closes a timestep: adds its per-phase counts to the totals and keeps them for the distributions.
+    void end_step() {
+        if (!active()) return;
+        for (int phase = 0; phase < kPhaseCount; ++phase) {
+            for (int e = 0; e < kPerfEventCount; ++e) total_[phase].v[e] += step_[phase].v[e];
+            if (steps_.size() < steps_.capacity()) steps_.push_back(step_[phase]);
+            step_[phase] = PerfSample();
+        }
+    }
+
+    // cells: grid cells per step, for misses per cell.
+    void report(std::ostream& out, double cells) const {
+        if (!enabled_) return;
+        if (!active()) {
+            out << "[perf] unavailable (" << error_ << ", perf_event_paranoid=" << paranoid() << ")\n";
+            return;
+        }
+        out << "[perf] groups=" << slots_ << " events=";
+        bool first = true;
+        std::string missing;
+        for (int e = 0; e < kPerfEventCount; ++e) {
+            if (groups_[0].has(e)) {
+                out << (first ? "" : ",") << perf_event_name(e);
+                first = false;
+            } else {
+                missing += (missing.empty() ? "" : ",") + std::string(perf_event_name(e));
+            }
+        }
+        if (!missing.empty()) {
+            out << " missing=" << missing << " (" << missing_ << ", perf_event_paranoid=" << paranoid() << ")";
+        }
+        out << "\n";
+        const std::size_t steps = steps_.size() / kPhaseCount;
+        for (int phase = 0; phase < kPhaseCount; ++phase) {
+            const PerfSample& t = total_[phase];
+            if (t.v[kPerfTaskClock] == 0) continue; // phase not timed by this engine
+            out << "[perf] phase=" << phase_name(phase);
+            for (int e = 0; e < kPerfEventCount; ++e) {
+                if (groups_[0].has(e)) out << " " << perf_event_name(e) << "=" << t.v[e];
+            }
+            if (groups_[0].has(kPerfCycles) && groups_[0].has(kPerfInstructions) && t.v[kPerfCycles]) {
+                out << " ipc=" << static_cast<double>(t.v[kPerfInstructions]) / t.v[kPerfCycles];
+            }
+            for (int e : {kPerfL1dMisses, kPerfLlcMisses, kPerfDtlbMisses}) {
+                if (groups_[0].has(e) && cells > 0.0 && steps) {
+                    out << " " << perf_event_name(e) << "_per_cell=" << kept_sum(phase, e) / (cells * steps);
+                }
+            }
+            out << "\n";
+            if (!steps) continue;
+            out << "[perf] phase=" << phase_name(phase) << " per_step(min/median/max) steps=" << steps;
+            for (int e = 0; e < kPerfEventCount; ++e) {
+                if (!groups_[0].has(e)) continue;
+                for (std::size_t s = 0; s < steps; ++s) sorted_[s] = steps_[s * kPhaseCount + phase].v[e];
+                std::sort(sorted_.begin(), sorted_.begin() + steps);
+                out << " " << perf_event_name(e) << "=" << sorted_[0] << "/" << sorted_[steps / 2] << "/"
+                    << sorted_[steps - 1];
+            }
+            out << "\n";
+        }
+    }
+
+private:
+    void sample(PerfSample& s) const {
+        s = PerfSample();
+        for (int slot = 0; slot < slots_; ++slot) groups_[slot].read_into(s);
+    }
+
+    // Sum over the kept steps (the per-cell figures divide by the same step count).
+    double kept_sum(int phase, int event) const {
+        double sum = 0.0;
+        for (std::size_t s = 0; s < steps_.size() / kPhaseCount; ++s) sum += steps_[s * kPhaseCount + phase].v[event];
+        return sum;
+    }
+
+    static int paranoid() {
+        std::ifstream in("/proc/sys/kernel/perf_event_paranoid");
+        int level = -99;
+        in >> level;
+        return level;
+    }
+
+    bool enabled_;
+    int slots_;
+    std::unique_ptr<PerfGroup[]> groups_;
+    std::string error_, missing_;
+    PerfSample start_[kPhaseCount], step_[kPhaseCount], total_[kPhaseCount];
+    std::vector<PerfSample> steps_; // [step][phase], first kPerfStepCap steps
+    mutable std::vector<std::uint64_t> sorted_; // scratch for the distributions
+};
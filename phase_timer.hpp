@@ -0,0 +1,414 @@
+/*
+High-Performance C++: Per-phase timing for the timestep loop
+Purpose: Split the elapsed time of a run into the phases of a timestep so bandwidth and cost per phase can be reported,
+         and measure the startup (allocation, pre-faulting, initialisation) that comes before the first timestep.
+Key ideas: Phase boundaries read the time-stamp counter (rdtscp, a few dozen cycles) instead of a system clock. The TSC
+           is calibrated against steady_clock once per run to convert ticks to ns; on other architectures the timer
+           falls back to steady_clock in ns. Every phase interval is also recorded, with its timestep, in a
+           fixed-capacity ring (the main thread's lives in PhaseTimer; workers get their own rings and ScopedSpan), so
+           the summary can give cycles per cell per phase and the spread of each phase over the timesteps without
+           allocating in the loop. TSC cycles are reference cycles at the nominal frequency, not core cycles.
+*/
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "machine_probe.hpp"
+#include "memory_report.hpp"
+#include "usdt_probes.hpp"
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+#define STENCIL_HAVE_TSC 1
+#elif defined(_M_X64)
+#include <intrin.h>
+#define STENCIL_HAVE_TSC 1
+#endif
+
+// The last three are not timestep phases: file I/O of the out-of-core engine and time spent waiting (at a barrier,
+// a join or for an I/O thread). They only appear in span rings and traces.
+enum Phase {
+    kPhaseInit,
+    kPhaseUpdate,
+    kPhaseBoundaries,
+    kPhaseScan,
+    kPhaseOutput,
+    kPhaseAverage,
+    kPhaseRead,
+    kPhaseWrite,
+    kPhaseWait,
+    kPhaseCount
+};
+
+inline const char* phase_name(int phase) {
+    static const char* const names[kPhaseCount] = {"init",    "update", "boundaries", "scan", "output",
+                                                   "average", "read",   "write",      "wait"};
+    return names[phase];
+}
+
+// Cells each phase touches per step (init once): the denominator of cycles per cell.
+inline void stencil_phase_cells(long long nx, long long ny, double cells[kPhaseCount]) {
+    const double all = static_cast<double>(nx) * ny;
+    cells[kPhaseInit] = all;
+    cells[kPhaseUpdate] = static_cast<double>(std::max(0LL, nx - 2)) * std::max(0LL, ny - 2);
+    cells[kPhaseBoundaries] = 2.0 * std::max(0LL, nx - 2) + 2.0 * std::max(0LL, ny - 2);
+    cells[kPhaseScan] = all;
+    cells[kPhaseOutput] = all;
+    cells[kPhaseAverage] = all;
+    cells[kPhaseRead] = cells[kPhaseWrite] = cells[kPhaseWait] = 0.0;
+}
+
+// Time-stamp counter ticks (steady_clock ns where there is no TSC).
+inline std::uint64_t tsc_now() {
+#ifdef STENCIL_HAVE_TSC
+    unsigned aux;
+    return __rdtscp(&aux);
+#else
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+#endif
+}
+
+struct TscCalibration {
+    double ticks_per_ns = 1.0;
+    bool tsc = false;       // false: ticks are steady_clock ns
+    bool invariant = false; // constant_tsc and nonstop_tsc reported by the CPU (Linux)
+};
+
+// Measured once per process over ~10 ms of steady_clock.
+inline const TscCalibration& tsc_calibration() {
+    static const TscCalibration calibration = [] {
+        TscCalibration c;
+#ifdef STENCIL_HAVE_TSC
+        c.tsc = true;
+        const auto t0 = std::chrono::steady_clock::now();
+        const std::uint64_t c0 = tsc_now();
+        std::chrono::steady_clock::time_point t1;
+        do {
+            t1 = std::chrono::steady_clock::now();
+        } while (t1 - t0 < std::chrono::milliseconds(10));
+        const std::uint64_t c1 = tsc_now();
+        c.ticks_per_ns = static_cast<double>(c1 - c0) / std::chrono::duration<double, std::nano>(t1 - t0).count();
+#ifdef __linux__
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        for (std::string line; std::getline(cpuinfo, line);) {
+            if (line.compare(0, 5, "flags") != 0) continue;
+            c.invariant = line.find(" constant_tsc") != std::string::npos &&
+                          line.find(" nonstop_tsc") != std::string::npos;
+            break;
+        }
+#endif
+#endif
+        return c;
+    }();
+    return calibration;
+}
+
+struct PhaseSpan {
+    std::uint64_t begin = 0, end = 0; // tsc_now() ticks
+    std::int32_t step = -1;           // timestep, -1 outside the loop (init, tuning)
+    std::int32_t phase = 0;
+};
+
+// Fixed-capacity record of one thread's phase spans; once full, the oldest are overwritten.
+constexpr std::size_t kPhaseRingCapacity = 8192;   // spans kept per thread for the reports
+constexpr std::size_t kTraceRingCapacity = 1 << 18; // with --trace (6 MB per ring), so a trace covers long runs
+
+class PhaseRing {
+public:
+    // thread: index of the owning worker, -1 for the main thread (passed to the USDT phase probes)
+    explicit PhaseRing(std::size_t capacity = 0, int thread = -1) { reset(capacity, thread); }
+
+    void reset(std::size_t capacity, int thread = -1) {
+        MemoryScope scope(kMemTiming);
+        spans_.assign(capacity, PhaseSpan());
+        next_ = 0;
+        recorded_ = 0;
+        thread_ = thread;
+    }
+    void push(const PhaseSpan& span) {
+        if (spans_.empty()) return;
+        spans_[next_] = span;
+        next_ = next_ + 1 == spans_.size() ? 0 : next_ + 1;
+        ++recorded_;
+    }
+    std::size_t size() const { return static_cast<std::size_t>(std::min<std::uint64_t>(recorded_, spans_.size())); }
+    std::size_t capacity() const { return spans_.size(); }
+    int thread() const { return thread_; }
+    std::uint64_t dropped() const { return recorded_ - size(); }
+    // i-th span still held, oldest first
+    const PhaseSpan& operator[](std::size_t i) const {
+        const std::size_t first = recorded_ > spans_.size() ? next_ : 0;
+        return spans_[(first + i) % spans_.size()];
+    }
+
+private:
+    std::vector<PhaseSpan> spans_;
+    std::size_t next_ = 0;
+    std::uint64_t recorded_ = 0;
+    int thread_ = -1;
+};
+
+// Records the enclosing scope as one span of a worker thread's ring.
+class ScopedSpan {
+public:
+    ScopedSpan(PhaseRing& ring, Phase phase, int step) : ring_(ring), phase_(phase), step_(step) {
+        STENCIL_PROBE3(phase_begin, step_, static_cast<int>(phase_), ring_.thread());
+        begin_ = tsc_now();
+    }
+    ~ScopedSpan() {
+        ring_.push({begin_, tsc_now(), step_, phase_});
+        STENCIL_PROBE3(phase_end, step_, static_cast<int>(phase_), ring_.thread());
+    }
+    ScopedSpan(const ScopedSpan&) = delete;
+    ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+private:
+    PhaseRing& ring_;
+    Phase phase_;
+    int step_;
+    std::uint64_t begin_;
+};
+
+// Told about every phase boundary of a PhaseTimer (perf_counters.hpp reads its counters there).
+class PhaseObserver {
+public:
+    virtual void phase_begin(Phase phase) = 0;
+    virtual void phase_end(Phase phase) = 0;
+
+protected:
+    ~PhaseObserver() = default;
+};
+
+// Accumulated TSC time per phase plus the main thread's span ring. An observer's own cost stays outside the timed
+// interval.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(std::size_t ring_capacity = kPhaseRingCapacity) : ring_(ring_capacity) {}
+
+    void observe(PhaseObserver* observer) { observer_ = observer; }
+    void set_step(int step) { step_ = step; }
+    void begin(Phase phase) {
+        STENCIL_PROBE3(phase_begin, step_, static_cast<int>(phase), -1);
+        if (observer_) observer_->phase_begin(phase);
+        start_[phase] = tsc_now();
+    }
+    void end(Phase phase) {
+        const std::uint64_t now = tsc_now();
+        total_[phase] += now - start_[phase];
+        ring_.push({start_[phase], now, step_, phase});
+        if (observer_) observer_->phase_end(phase);
+        STENCIL_PROBE3(phase_end, step_, static_cast<int>(phase), -1);
+    }
+    std::uint64_t ticks(Phase phase) const { return total_[phase]; }
+    double seconds(Phase phase) const { return total_[phase] / tsc_calibration().ticks_per_ns * 1e-9; }
+    const PhaseRing& ring() const { return ring_; }
+
+    // "[tsc] ..." lines: clock, overhead, and per phase the total, TSC cycles per cell and the per-step spread
+    // (min / median / p95 / max over the timesteps still in the ring).
+    void report(std::ostream& out, const double cells[kPhaseCount], int steps) const {
+        const TscCalibration& cal = tsc_calibration();
+        std::uint64_t timed = 0;
+        for (int phase = 0; phase < kPhaseCount; ++phase) timed += total_[phase];
+        scratch_.resize(ring_.size());
+        const double overhead_ticks = begin_end_cost() * (ring_.size() + ring_.dropped());
+        out << "[tsc] source=" << (cal.tsc ? "rdtscp" : "steady_clock") << " ticks_per_ns=" << cal.ticks_per_ns
+            << " invariant=" << (cal.invariant ? "yes" : "no") << " spans=" << ring_.size()
+            << " dropped=" << ring_.dropped() << " overhead_pct=" << (timed ? 100.0 * overhead_ticks / timed : 0.0)
+            << "\n";
+        for (int phase = 0; phase < kPhaseCount; ++phase) {
+            if (total_[phase] == 0) continue;
+            const double runs = phase == kPhaseInit ? 1.0 : std::max(1, steps);
+            out << "[tsc] phase=" << phase_name(phase) << " total_ms=" << total_[phase] / cal.ticks_per_ns * 1e-6
+                << " cycles_per_cell=" << (cells[phase] > 0.0 ? total_[phase] / (cells[phase] * runs) : 0.0);
+            std::size_t n = 0;
+            for (std::size_t i = 0; i < ring_.size(); ++i) {
+                const PhaseSpan& span = ring_[i];
+                if (span.phase == phase && span.step >= 0) scratch_[n++] = span.end - span.begin;
+            }
+            if (n > 0) {
+                std::sort(scratch_.begin(), scratch_.begin() + n);
+                const double to_us = 1e-3 / cal.ticks_per_ns;
+                out << " step_us(min/median/p95/max)=" << scratch_[0] * to_us << "/" << scratch_[n / 2] * to_us << "/"
+                    << scratch_[std::min(n - 1, n * 95 / 100)] * to_us << "/" << scratch_[n - 1] * to_us
+                    << " steps=" << n;
+            }
+            out << "\n";
+        }
+    }
+
+private:
+    // Ticks for one begin/end pair: two clock reads and a span store, measured on a stack array (no heap).
+    static double begin_end_cost() {
+        static const double cost = [] {
+            PhaseSpan spans[64];
+            const int pairs = 1024;
+            const std::uint64_t t0 = tsc_now();
+            for (int k = 0; k < pairs; ++k) {
+                const std::uint64_t begin = tsc_now();
+                spans[k % 64] = {begin, tsc_now(), k, kPhaseUpdate};
+                asm volatile("" : : "r"(spans) : "memory");
+            }
+            return static_cast<double>(tsc_now() - t0) / pairs;
+        }();
+        return cost;
+    }
+
+    std::uint64_t start_[kPhaseCount] = {};
+    std::uint64_t total_[kPhaseCount] = {};
+    int step_ = -1;
+    PhaseRing ring_;
+    mutable std::vector<std::uint64_t> scratch_; // sorted span lengths, sized by the report (outside the loop)
+    PhaseObserver* observer_ = nullptr;
+};
+
+// Busy time of the worker rings per phase: "[tsc] workers=N phase=... busy_cycles_per_cell=..." (sum over threads,
+// timestep spans only), to set against the wall-clock cycles per cell of the same phase.
+inline void report_worker_rings(std::ostream& out, const PhaseRing* rings, int count, const double cells[kPhaseCount],
+                                int steps) {
+    std::uint64_t busy[kPhaseCount] = {}, dropped = 0;
+    for (int tid = 0; tid < count; ++tid) {
+        dropped += rings[tid].dropped();
+        for (std::size_t i = 0; i < rings[tid].size(); ++i) {
+            const PhaseSpan& span = rings[tid][i];
+            if (span.step >= 0) busy[span.phase] += span.end - span.begin;
+        }
+    }
+    for (int phase = 0; phase < kPhaseCount; ++phase) {
+        if (busy[phase] == 0) continue;
+        out << "[tsc] workers=" << count << " phase=" << phase_name(phase) << " busy_cycles_per_cell="
+            << (cells[phase] > 0.0 ? busy[phase] / (cells[phase] * std::max(1, steps)) : 0.0)
+            << " dropped=" << dropped << "\n";
+    }
+}
+
+// Load balance of the fork-join phases, from the worker rings and the ring of the coordinating thread (the one that
+// forks each parallel phase and joins it; its span of the phase covers the whole region). A worker's span of a region
+// splits the region's wall time into start (fork until the worker begins), busy, and wait (until the last worker is
+// done and the region is joined). Prints per phase "[imbalance] phase=... wall_ms= busy_ms(mean/max)= imbalance=
+// step_imbalance(mean/max)= start_ms(mean/max)= wait_ms(mean/max)= sync_pct=" and per thread
+// "[imbalance] thread=... busy_ms= start_ms= wait_ms=" over all phases. imbalance is max/mean of the run's busy time
+// per thread; step_imbalance is the same ratio per region, where imbalance shows up even if it evens out over steps.
+// sync_pct is the share of thread time in the regions spent not working. Only timestep spans still in the rings count.
+inline void report_imbalance(std::ostream& out, const PhaseRing* rings, int count, const PhaseRing& coordinator) {
+    struct Thread {
+        std::size_t next = 0; // first span of the ring not matched to a region yet
+        std::uint64_t busy[kPhaseCount] = {}, start[kPhaseCount] = {}, wait[kPhaseCount] = {};
+    };
+    std::unique_ptr<Thread[]> threads(new Thread[count]);
+    std::uint64_t wall[kPhaseCount] = {};
+    double step_sum[kPhaseCount] = {}, step_max[kPhaseCount] = {};
+    int regions[kPhaseCount] = {}, complete[kPhaseCount] = {};
+    for (std::size_t c = 0; c < coordinator.size(); ++c) {
+        const PhaseSpan& region = coordinator[c];
+        if (region.step < 0) continue;
+        std::uint64_t sum = 0, longest = 0;
+        int matched = 0;
+        for (int tid = 0; tid < count; ++tid) {
+            const PhaseRing& ring = rings[tid];
+            Thread& thread = threads[tid];
+            while (thread.next < ring.size() && ring[thread.next].end < region.begin) ++thread.next;
+            if (thread.next == ring.size()) continue;
+            const PhaseSpan& span = ring[thread.next];
+            if (span.phase != region.phase || span.step != region.step || span.begin < region.begin ||
+                span.end > region.end) {
+                continue;
+            }
+            ++thread.next;
+            const std::uint64_t busy = span.end - span.begin;
+            thread.busy[span.phase] += busy;
+            thread.start[span.phase] += span.begin - region.begin;
+            thread.wait[span.phase] += region.end - span.end;
+            sum += busy;
+            longest = std::max(longest, busy);
+            ++matched;
+        }
+        if (matched == 0) continue; // a serial phase
+        wall[region.phase] += region.end - region.begin;
+        ++regions[region.phase];
+        if (matched == count && sum > 0) {
+            const double ratio = static_cast<double>(longest) * count / sum;
+            step_sum[region.phase] += ratio;
+            step_max[region.phase] = std::max(step_max[region.phase], ratio);
+            ++complete[region.phase];
+        }
+    }
+
+    const double to_ms = 1e-6 / tsc_calibration().ticks_per_ns;
+    for (int phase = 0; phase < kPhaseCount; ++phase) {
+        if (regions[phase] == 0) continue;
+        std::uint64_t busy_sum = 0, busy_max = 0, start_sum = 0, start_max = 0, wait_sum = 0, wait_max = 0;
+        for (int tid = 0; tid < count; ++tid) {
+            const Thread& thread = threads[tid];
+            busy_sum += thread.busy[phase];
+            busy_max = std::max(busy_max, thread.busy[phase]);
+            start_sum += thread.start[phase];
+            start_max = std::max(start_max, thread.start[phase]);
+            wait_sum += thread.wait[phase];
+            wait_max = std::max(wait_max, thread.wait[phase]);
+        }
+        out << "[imbalance] threads=" << count << " phase=" << phase_name(phase) << " regions=" << regions[phase]
+            << " wall_ms=" << wall[phase] * to_ms << " busy_ms(mean/max)=" << busy_sum * to_ms / count << "/"
+            << busy_max * to_ms << " imbalance=" << (busy_sum ? static_cast<double>(busy_max) * count / busy_sum : 1.0)
+            << " step_imbalance(mean/max)=" << (complete[phase] ? step_sum[phase] / complete[phase] : 1.0) << "/"
+            << (complete[phase] ? step_max[phase] : 1.0) << " start_ms(mean/max)=" << start_sum * to_ms / count << "/"
+            << start_max * to_ms << " wait_ms(mean/max)=" << wait_sum * to_ms / count << "/" << wait_max * to_ms
+            << " sync_pct=" << (wall[phase] ? 100.0 * (start_sum + wait_sum) / (1.0 * wall[phase] * count) : 0.0)
+            << "\n";
+    }
+    for (int tid = 0; tid < count; ++tid) {
+        std::uint64_t busy = 0, start = 0, wait = 0;
+        for (int phase = 0; phase < kPhaseCount; ++phase) {
+            busy += threads[tid].busy[phase];
+            start += threads[tid].start[phase];
+            wait += threads[tid].wait[phase];
+        }
+        out << "[imbalance] thread=" << tid << " busy_ms=" << busy * to_ms << " start_ms=" << start * to_ms
+            << " wait_ms=" << wait * to_ms << " dropped=" << rings[tid].dropped() << "\n";
+    }
+}
+
+// Times the enclosing scope as one phase.
+class ScopedPhase {
+public:
+    ScopedPhase(PhaseTimer& timer, Phase phase) : timer_(timer), phase_(phase) { timer_.begin(phase_); }
+    ~ScopedPhase() { timer_.end(phase_); }
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+private:
+    PhaseTimer& timer_;
+    Phase phase_;
+};
+
+// Wall time and page faults from construction (first thing in main) to the first timestep, and faults after it.
+class StartupProbe {
+public:
+    StartupProbe() : start_(std::chrono::steady_clock::now()), faults_start_(page_faults()) {}
+
+    void first_step() {
+        to_first_step_ = std::chrono::steady_clock::now() - start_;
+        faults_first_step_ = page_faults();
+    }
+
+    void report(std::ostream& out, const char* prefault) const {
+        const PageFaults now = page_faults();
+        out << "[startup] prefault=" << prefault << " time_to_first_step_ms="
+            << std::chrono::duration<double, std::milli>(to_first_step_).count()
+            << " startup_minor_faults=" << faults_first_step_.minor - faults_start_.minor
+            << " startup_major_faults=" << faults_first_step_.major - faults_start_.major
+            << " run_minor_faults=" << now.minor - faults_first_step_.minor << "\n";
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::duration to_first_step_{};
+    PageFaults faults_start_, faults_first_step_;
+};
@@ -0,0 +1,173 @@
+/*
+High-Performance C++: Roofline report for the timestep phases
+Purpose: Put the measured phase times next to what the machine can do: bytes moved and floating-point operations per
+         phase (from nx, ny, nt), the achieved GB/s and GFLOP/s, the arithmetic intensity, and how close each phase
+         gets to its roof min(peak GFLOP/s, intensity * peak GB/s).
+Key ideas: The traffic model counts every array element once per pass (neighbours of the five-point update come from
+           cache) plus the read-for-ownership of destination lines, which normal stores pay and streaming stores do
+           not. Interleaved fields (stencil_grid.hpp) move both halves of every line, and a pass that writes one field
+           writes back the other too. The bandwidth roof is the calibrated triad bandwidth (stream_probe.hpp) of the
+           cache level the grid fits in, at the engine's thread count, when the host has a calibration file;
+           otherwise a scale kernel b = a * q over two arrays larger than the last-level cache (capped at 128 MB
+           each) is timed on the spot. The compute roof is always measured: independent multiply-add chains on an
+           L1-resident array, with the engine's flags and thread count.
+Notes: Flops per cell: update 4 (three adds, one multiply), boundaries 4, scan 2 (subtract, compare; fabs is a sign
+       mask), average 2. The output phase writes text and has no roof; engines that format hits inside the scan
+       report both together as the scan.
+*/
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "machine_probe.hpp"
+#include "phase_timer.hpp"
+#include "stream_probe.hpp"
+
+struct PhaseCost {
+    double bytes = 0.0;
+    double flops = 0.0;
+};
+
+// Modelled traffic and work of one phase over nt steps of an nx x ny grid.
+inline PhaseCost phase_cost(Phase phase, long long nx, long long ny, int nt, bool write_allocate,
+                            bool interleaved = false) {
+    const double d = sizeof(double);
+    const double all = static_cast<double>(nx) * ny;
+    const double interior = static_cast<double>(std::max(0LL, nx - 2)) * std::max(0LL, ny - 2);
+    const double edge = 2.0 * std::max(0LL, nx - 2) + 2.0 * std::max(0LL, ny - 2);
+    const double rfo = write_allocate ? 1.0 : 0.0;
+    PhaseCost cost;
+    switch (phase) {
+    case kPhaseUpdate: // read vi, write vr
+        cost.bytes = interior * d * (interleaved ? 4.0 : 2.0 + rfo);
+        cost.flops = 4.0 * interior;
+        break;
+    case kPhaseBoundaries: // three neighbours and one store per edge cell, no reuse along the columns
+        cost.bytes = edge * d * (4.0 + rfo);
+        cost.flops = 4.0 * edge;
+        break;
+    case kPhaseScan: // read vi and vr
+        cost.bytes = all * d * 2.0;
+        cost.flops = 2.0 * all;
+        break;
+    case kPhaseAverage: // read vi and vr, write vi (its lines are already in cache)
+        cost.bytes = all * d * (interleaved ? 4.0 : 3.0);
+        cost.flops = 2.0 * all;
+        break;
+    default:
+        break;
+    }
+    cost.bytes *= nt;
+    cost.flops *= nt;
+    return cost;
+}
+
+struct MachinePeaks {
+    double gbps = 0.0;      // read-for-ownership included
+    double gflops = 0.0;    // independent multiply-add chains
+    std::string bw_source;  // where gbps came from
+    int threads = 1;
+};
+
+// Peaks for a run of `threads` threads over a working set of `working_set` bytes.
+inline MachinePeaks measure_peaks(const CacheSizes& caches, int threads, std::size_t working_set) {
+    MachinePeaks peaks;
+    peaks.threads = std::max(1, threads);
+    const int level = stream_level_for(working_set, peaks.threads, caches);
+    const StreamTable* table = cached_stream_table();
+    if (const StreamRow* row = table ? table->find(level, peaks.threads) : nullptr) {
+        peaks.gbps = row->traffic_gbps();
+        peaks.bw_source = std::string("calibrated ") + stream_level_name(level) + " triad";
+    } else {
+        peaks.bw_source = "scale kernel, not calibrated";
+    }
+    if (peaks.gbps == 0.0) {
+        const std::size_t cap = std::size_t(128) << 20;
+        const std::size_t array_bytes = std::min(cap, std::max(std::size_t(32) << 20, 4 * caches.llc));
+        const std::size_t n = array_bytes / sizeof(double);
+        std::vector<double> a(n, 1.0), b(n, 0.0);
+
+        // every thread scales its own slice; the first sweep only warms up, the best of the rest counts
+        const int sweeps = 4;
+        double best = 0.0;
+        for (int sweep = 0; sweep < sweeps; ++sweep) {
+            const double s = time_on_threads(peaks.threads, [&](int tid) {
+                const std::size_t begin = n * tid / peaks.threads, end = n * (tid + 1) / peaks.threads;
+                double* __restrict out = b.data();
+                const double* __restrict in = a.data();
+                for (std::size_t k = begin; k < end; ++k) out[k] = in[k] * 0.5;
+            });
+            if (sweep > 0 && (best == 0.0 || s < best)) best = s;
+        }
+        peaks.gbps = 3.0 * n * sizeof(double) / best * 1e-9;
+    }
+
+    // arithmetic: 16 independent chains per thread, vectorised by the compiler, values stay bounded
+    const long reps = 4000000;
+    std::vector<double> sums(peaks.threads, 0.0);
+    const double s = time_on_threads(peaks.threads, [&](int tid) {
+        double acc[16];
+        for (int k = 0; k < 16; ++k) acc[k] = 1.0 + k;
+        for (long r = 0; r < reps; ++r) {
+            for (int k = 0; k < 16; ++k) acc[k] = acc[k] * 0.999999 + 1e-6;
+        }
+        double sum = 0.0;
+        for (double v : acc) sum += v;
+        sums[tid] = sum; // keeps the chains alive
+    });
+    peaks.gflops = 2.0 * 16 * reps * peaks.threads / s * 1e-9;
+    volatile double sink = sums[0];
+    (void)sink;
+    return peaks;
+}
+
+struct RooflineRow {
+    Phase phase;
+    PhaseCost cost;
+    double seconds;
+};
+
+// Prints the roofline table and, with a non-empty csv_path, writes the same rows as CSV for plotting.
+inline void report_roofline(std::ostream& out, const char* engine, const MachinePeaks& peaks,
+                            const std::vector<RooflineRow>& rows, const std::string& csv_path) {
+    const double ridge = peaks.gflops / peaks.gbps;
+    out << "[roofline] peak_GBps=" << peaks.gbps << " peak_GFLOPs=" << peaks.gflops << " ridge_flops_per_byte=" << ridge
+        << " (" << peaks.threads << " threads, " << peaks.bw_source << ")\n";
+    out << "[roofline] " << std::left << std::setw(12) << "phase" << std::right << std::setw(10) << "GB"
+        << std::setw(10) << "GFLOP" << std::setw(10) << "time_ms" << std::setw(9) << "GB/s" << std::setw(9)
+        << "GFLOP/s" << std::setw(9) << "flops/B" << std::setw(9) << "of_roof" << "  bound\n";
+    std::ofstream csv;
+    if (!csv_path.empty()) {
+        csv.open(csv_path);
+        csv << "engine,phase,bytes,flops,seconds,gbps,gflops,flops_per_byte,peak_gbps,peak_gflops,roof_gflops,"
+               "fraction_of_roof\n";
+    }
+    const std::ios::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    for (const RooflineRow& row : rows) {
+        const double secs = std::max(row.seconds, 1e-12);
+        const double gbps = row.cost.bytes / secs * 1e-9, gflops = row.cost.flops / secs * 1e-9;
+        const double intensity = row.cost.bytes > 0.0 ? row.cost.flops / row.cost.bytes : 0.0;
+        const double roof = std::min(peaks.gflops, intensity * peaks.gbps);
+        const double fraction = roof > 0.0 ? gflops / roof : 0.0;
+        out << "[roofline] " << std::left << std::setw(12) << phase_name(row.phase) << std::right << std::setw(10)
+            << row.cost.bytes * 1e-9 << std::setw(10) << row.cost.flops * 1e-9 << std::setw(10) << row.seconds * 1e3
+            << std::setw(9) << gbps << std::setw(9) << gflops << std::setw(9) << intensity << std::setw(9) << fraction
+            << "  " << (intensity < ridge ? "memory" : "compute") << "\n";
+        if (csv.is_open()) {
+            csv << engine << "," << phase_name(row.phase) << "," << row.cost.bytes << "," << row.cost.flops << ","
+                << row.seconds << "," << gbps << "," << gflops << "," << intensity << "," << peaks.gbps << ","
+                << peaks.gflops << "," << roof << "," << fraction << "\n";
+        }
+    }
+    out.flags(flags);
+    out.precision(precision);
+    if (csv.is_open()) out << "[roofline] wrote " << csv_path << "\n";
+}
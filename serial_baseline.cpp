@@ -7,6 +7,8 @@ Notes: Straightforward 2D five-point stencil update; no cache or parallel optimi
 #include <fstream>
 #include <math.h> // potential poor practice: should use <cmath> for C++ compatibility
 #include <chrono>
+#include <cstring>
+#include "grid_dump.hpp"
 using namespace std;
 
 int main(int argc, char* argv[]) {
@@ -17,7 +19,7 @@ int main(int argc, char* argv[]) {
 
         int nt(200);   //^^
 
-        // Optional CLI: nx ny nt
+        // Optional CLI: nx ny nt [--dump-grid=path] (final vi for verify_engines; everything else is ignored)
         if (argc >= 4) {
                 nx = atoi(argv[1]);
                 ny = atoi(argv[2]);
@@ -102,4 +104,12 @@ int main(int argc, char* argv[]) {
         auto t_end = std::chrono::high_resolution_clock::now();
         auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(t_end - t_start).count();
         cout << "\n[chrono] time_ms=" << elapsed_ms << "\n";
+        auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count();
+        cout << "[chrono] time_us=" << elapsed_us << "\n";
+
+        for (int a = 4; a < argc; a++) {
+                if (strncmp(argv[a], "--dump-grid=", 12) == 0) {
+                        write_grid_dump(argv[a] + 12, nx, ny, [&](long long i, long long j) { return vi[i][j]; });
+                }
+        }
 }
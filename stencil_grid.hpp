@@ -0,0 +1,246 @@
+/*
+High-Performance C++: Grid storage shared by the optimized engines
+Purpose: Own the vi/vr arrays and decide their row stride, element order and relative placement in memory.
+Key ideas: Rows are padded to whole cache lines and skewed so that neighbouring rows do not fall into the same cache
+           sets at power-of-two widths; vr is offset from vi so loads of vi[k] and stores to vr[k] never 4K-alias.
+           Besides plain row-major order the grid can be stored as square tiles (each tile contiguous), with the
+           tiles either in row-major order or along a Z-order (Morton) curve.
+           Large grids can be pre-faulted: allocated with MAP_POPULATE (Linux) so the kernel maps every page up front,
+           or touched page by page from several threads (touch_pages) before the single-threaded initialisation.
+           The two fields are either separate arrays or interleaved AoSoA-style in blocks of one SIMD register
+           (4 vi, then 4 vr, ...), so passes that read both fields pull a single stream; kernels address them through
+           the SeparateFields / InterleavedFields accessors with the storage index from at() or for_each_segment().
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <vector>
+#include "memory_report.hpp"
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+constexpr std::size_t kCacheLineBytes = 64;
+constexpr std::size_t kLineDoubles = kCacheLineBytes / sizeof(double);
+constexpr std::size_t kPageBytes = 4096;
+
+// Distance between the vi and vr base addresses modulo a page: half a page plus one line, so vi[k] and vr[k]
+// (and their row neighbours) differ in the low 12 address bits used by the store-forwarding alias check.
+constexpr std::size_t kFieldSkewBytes = kPageBytes / 2 + kCacheLineBytes;
+
+enum class GridLayout { RowMajor, Tiled, Morton };
+
+inline const char* layout_name(GridLayout layout) {
+    switch (layout) {
+    case GridLayout::Tiled: return "tiled";
+    case GridLayout::Morton: return "morton";
+    default: return "row";
+    }
+}
+
+inline bool parse_layout(const char* text, GridLayout& layout) {
+    if (std::strcmp(text, "row") == 0) layout = GridLayout::RowMajor;
+    else if (std::strcmp(text, "tiled") == 0) layout = GridLayout::Tiled;
+    else if (std::strcmp(text, "morton") == 0) layout = GridLayout::Morton;
+    else return false;
+    return true;
+}
+
+enum class FieldLayout { Separate, Interleaved };
+
+inline const char* field_layout_name(FieldLayout fields) {
+    return fields == FieldLayout::Interleaved ? "interleaved" : "separate";
+}
+
+inline bool parse_field_layout(const char* text, FieldLayout& fields) {
+    if (std::strcmp(text, "separate") == 0) fields = FieldLayout::Separate;
+    else if (std::strcmp(text, "interleaved") == 0) fields = FieldLayout::Interleaved;
+    else return false;
+    return true;
+}
+
+// Doubles of one field per interleaved block: one AVX register, so a block of vi and the matching block of vr share
+// a cache line.
+constexpr std::size_t kFieldBlock = 4;
+
+// vi and vr as two arrays; element e of a field is vi_base[e] / vr_base[e].
+struct SeparateFields {
+    double* vi_base;
+    double* vr_base;
+    double& vi(std::size_t e) const { return vi_base[e]; }
+    double& vr(std::size_t e) const { return vr_base[e]; }
+};
+
+// vi and vr interleaved in blocks of kFieldBlock: [vi e..e+3][vr e..e+3][vi e+4..e+7]...
+struct InterleavedFields {
+    double* base;
+    static std::size_t slot(std::size_t e) { return (e / kFieldBlock) * 2 * kFieldBlock + e % kFieldBlock; }
+    double& vi(std::size_t e) const { return base[slot(e)]; }
+    double& vr(std::size_t e) const { return base[slot(e) + kFieldBlock]; }
+};
+
+// Row stride in doubles for rows of ny values.
+// pad_lines == -2: no padding (stride == ny, the original layout).
+// pad_lines == -1: round up to whole cache lines and make the count odd; rows i-1, i, i+1 then map to different
+//                  sets for any power-of-two set count (ny = 256, 512, 1024 would otherwise alias row to row).
+// pad_lines >= 0:  round up to whole cache lines and add exactly pad_lines lines of skew.
+inline std::size_t padded_stride(int ny, int pad_lines) {
+    if (pad_lines == -2) return static_cast<std::size_t>(ny);
+    std::size_t lines = (static_cast<std::size_t>(ny) + kLineDoubles - 1) / kLineDoubles;
+    if (pad_lines == -1) {
+        if (lines % 2 == 0) ++lines;
+    } else {
+        lines += static_cast<std::size_t>(pad_lines);
+    }
+    return lines * kLineDoubles;
+}
+
+// Interleaves the bits of (ti, tj) into a Z-order key.
+inline std::uint64_t morton_key(std::uint32_t ti, std::uint32_t tj) {
+    std::uint64_t key = 0;
+    for (int b = 0; b < 32; ++b) {
+        key |= static_cast<std::uint64_t>((tj >> b) & 1u) << (2 * b);
+        key |= static_cast<std::uint64_t>((ti >> b) & 1u) << (2 * b + 1);
+    }
+    return key;
+}
+
+// vi and vr in one page-aligned block.
+// Row-major: element (i, j) lives at i * stride + j (the whole grid is a single tile).
+// Tiled/Morton: the grid is cut into tile x tile blocks; each block is stored contiguously with its own padded row
+// stride, and blocks follow each other in row-major (Tiled) or Z-order (Morton) sequence. Every tile row is a
+// contiguous run, so kernels work on row segments via for_each_segment() and only look up neighbours in adjacent
+// tiles through at().
+class StencilGrid {
+public:
+    int nx, ny;
+    GridLayout layout;
+    FieldLayout fields;
+    int tile_rows, tile_cols;   // extent of one tile (nx x ny for row-major)
+    std::size_t stride;         // row stride inside a tile
+    double* vi;
+    double* vr;
+
+    // with_vr == false allocates vi only (vr stays nullptr) for engines that keep the new state elsewhere.
+    // populate == true maps the block with MAP_POPULATE where available (all pages faulted in by the kernel).
+    // FieldLayout::Interleaved keeps both fields in one interleaved array at vi (vr stays nullptr): use interleaved().
+    StencilGrid(int nx_, int ny_, int pad_lines, GridLayout layout_ = GridLayout::RowMajor, int tile = 64,
+                bool with_vr = true, bool populate = false, FieldLayout fields_ = FieldLayout::Separate)
+        : nx(nx_), ny(ny_), layout(layout_), fields(fields_) {
+        if (layout == GridLayout::RowMajor) {
+            tile_rows = nx;
+            tile_cols = ny;
+        } else {
+            tile_rows = std::min(tile, nx);
+            tile_cols = std::min(tile, ny);
+        }
+        stride = padded_stride(tile_cols, pad_lines);
+        tiles_y_ = (nx + tile_rows - 1) / tile_rows;
+        tiles_x_ = (ny + tile_cols - 1) / tile_cols;
+        tile_elems_ = static_cast<std::size_t>(tile_rows) * stride;
+
+        // slot_of_tile_[ti * tiles_x + tj] = position of tile (ti, tj) in memory; tile_of_slot_ is the inverse
+        MemoryScope index_scope(kMemIndex);
+        const std::size_t ntiles = static_cast<std::size_t>(tiles_y_) * tiles_x_;
+        tile_of_slot_.resize(ntiles);
+        for (std::size_t t = 0; t < ntiles; ++t) tile_of_slot_[t] = static_cast<std::uint32_t>(t);
+        if (layout == GridLayout::Morton) {
+            const int tx = tiles_x_;
+            std::sort(tile_of_slot_.begin(), tile_of_slot_.end(), [tx](std::uint32_t a, std::uint32_t b) {
+                return morton_key(a / tx, a % tx) < morton_key(b / tx, b % tx);
+            });
+        }
+        slot_of_tile_.resize(ntiles);
+        for (std::size_t s = 0; s < ntiles; ++s) slot_of_tile_[tile_of_slot_[s]] = static_cast<std::uint32_t>(s);
+
+        const std::size_t field_bytes = ntiles * tile_elems_ * sizeof(double);
+        const std::size_t vi_span = (field_bytes + kPageBytes - 1) / kPageBytes * kPageBytes;
+        // Without padding keep the old behaviour (both fields page aligned) so the two layouts can be compared.
+        const std::size_t vr_offset = vi_span + (pad_lines == -2 ? 0 : kFieldSkewBytes);
+        field_bytes_ = field_bytes;
+        bytes_ = with_vr ? vr_offset + field_bytes : field_bytes;
+        if (fields == FieldLayout::Interleaved) {
+            const std::size_t blocks = (ntiles * tile_elems_ + kFieldBlock - 1) / kFieldBlock;
+            bytes_ = blocks * 2 * kFieldBlock * sizeof(double);
+            with_vr = false;
+        }
+#if defined(__linux__) && defined(MAP_POPULATE)
+        if (populate) {
+            void* p = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+            if (p == MAP_FAILED) throw std::bad_alloc();
+            block_ = static_cast<char*>(p);
+            mapped_ = true;
+            memory_charge(kMemGrid, static_cast<std::int64_t>(bytes_));
+        }
+#else
+        (void)populate;
+#endif
+        if (!mapped_) {
+            MemoryScope grid_scope(kMemGrid);
+            block_ = static_cast<char*>(::operator new(bytes_, std::align_val_t(kPageBytes)));
+        }
+        vi = reinterpret_cast<double*>(block_);
+        vr = with_vr ? reinterpret_cast<double*>(block_ + vr_offset) : nullptr;
+    }
+
+    ~StencilGrid() {
+#if defined(__linux__)
+        if (mapped_) {
+            munmap(block_, bytes_);
+            memory_charge(kMemGrid, -static_cast<std::int64_t>(bytes_));
+            return;
+        }
+#endif
+        ::operator delete(block_, std::align_val_t(kPageBytes));
+    }
+
+    StencilGrid(const StencilGrid&) = delete;
+    StencilGrid& operator=(const StencilGrid&) = delete;
+
+    // Storage index of element (i, j) in either field.
+    std::size_t at(int i, int j) const {
+        if (layout == GridLayout::RowMajor) return static_cast<std::size_t>(i) * stride + j;
+        const int ti = i / tile_rows, tj = j / tile_cols;
+        const std::size_t slot = slot_of_tile_[static_cast<std::size_t>(ti) * tiles_x_ + tj];
+        return slot * tile_elems_ + static_cast<std::size_t>(i - ti * tile_rows) * stride + (j - tj * tile_cols);
+    }
+
+    // Calls f(i, j0, j1, offset) for every contiguous row segment [j0, j1) of row i, in storage order;
+    // element (i, j) of the segment is at offset + (j - j0).
+    template <class F>
+    void for_each_segment(F&& f) const {
+        for (std::size_t s = 0; s < tile_of_slot_.size(); ++s) {
+            const int ti = static_cast<int>(tile_of_slot_[s] / tiles_x_);
+            const int tj = static_cast<int>(tile_of_slot_[s] % tiles_x_);
+            const int i0 = ti * tile_rows, i1 = std::min(nx, i0 + tile_rows);
+            const int j0 = tj * tile_cols, j1 = std::min(ny, j0 + tile_cols);
+            std::size_t offset = s * tile_elems_;
+            for (int i = i0; i < i1; ++i, offset += stride) f(i, j0, j1, offset);
+        }
+    }
+
+    std::size_t bytes() const { return bytes_; }
+    std::size_t field_bytes() const { return field_bytes_; } // one of vi/vr, padding included
+    bool populated() const { return mapped_; }
+
+    SeparateFields separate() const { return {vi, vr}; }
+    InterleavedFields interleaved() const { return {vi}; }
+
+    // Faults in pages [first, last) of the block by writing to each; threads can take disjoint page ranges.
+    std::size_t pages() const { return (bytes_ + kPageBytes - 1) / kPageBytes; }
+    void touch_pages(std::size_t first, std::size_t last) {
+        for (std::size_t p = first; p < last; ++p) block_[p * kPageBytes] = 0;
+    }
+
+private:
+    int tiles_y_, tiles_x_;
+    std::size_t tile_elems_;
+    std::vector<std::uint32_t> tile_of_slot_, slot_of_tile_;
+    char* block_ = nullptr;
+    bool mapped_ = false;
+    std::size_t bytes_, field_bytes_;
+};
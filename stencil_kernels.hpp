@@ -0,0 +1,133 @@
+/*
+High-Performance C++: Row-segment kernels shared by the optimized engines
+Purpose: One place for the hot interior update so every engine and layout runs the same arithmetic.
+Key ideas: A segment is a contiguous piece of row i; up/c/dn point at the same columns of rows i-1, i, i+1.
+           The sum is always (down + up + left + right) * 0.25, the baseline's order, so all variants agree bit for bit.
+           The streaming-store variant writes vr with non-temporal stores: when the grid is far larger than the
+           last-level cache the lines of vr would be evicted before reuse anyway, and skipping the read-for-ownership
+           of each destination line saves about a third of the update's memory traffic.
+           The prefetching variants issue one software prefetch per cache line for the same columns a few rows ahead
+           (pf_vi / pf_vr, chosen by the caller from the prefetch distance), for the cases where the hardware
+           prefetcher loses track: many threads streaming different row ranges, or jumps between tiles.
+*/
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Generic form of the interior update: out[k] = (a[k] + b[k] + l[k] + r[k]) * quarter, summed left to right.
+// Row-major storage passes (dn, up, c - 1, c + 1); transposed storage (rows of the grid are columns in memory) passes
+// (c + 1, c - 1, up, dn), which are the same four neighbours in the baseline's order, so both agree bit for bit.
+static inline void sum4_segment(const double* a, const double* b, const double* l, const double* r, double* out,
+                                int kb, int ke, double quarter) {
+    for (int k = kb; k < ke; ++k) {
+        out[k] = (a[k] + b[k] + l[k] + r[k]) * quarter;
+    }
+}
+
+// sum4_segment plus a read prefetch of pf_vi and a write prefetch of pf_vr (either may be null) once per line.
+static inline void sum4_segment_pf(const double* a, const double* b, const double* l, const double* r, double* out,
+                                   int kb, int ke, double quarter, const double* pf_vi, double* pf_vr) {
+    int k = kb;
+    while (k < ke) {
+        const int line_end = std::min(ke, (k & ~7) + 8); // 8 doubles per 64-byte line
+        if (pf_vi) __builtin_prefetch(pf_vi + k, 0, 3);
+        if (pf_vr) __builtin_prefetch(pf_vr + k, 1, 3);
+        for (; k < line_end; ++k) {
+            out[k] = (a[k] + b[k] + l[k] + r[k]) * quarter;
+        }
+    }
+}
+
+// Same as sum4_segment, but stores bypass the cache. Call stream_fence() before vr is read by another thread.
+// pf_vi (optional) is prefetched once per line; vr needs no prefetch since streaming stores do not read it.
+static inline void sum4_segment_nt(const double* a, const double* b, const double* l, const double* r, double* out,
+                                   int kb, int ke, double quarter, const double* pf_vi = nullptr) {
+#if defined(__AVX__)
+    int k = kb;
+    for (; k < ke && (reinterpret_cast<std::uintptr_t>(out + k) & 31) != 0; ++k) {
+        out[k] = (a[k] + b[k] + l[k] + r[k]) * quarter;
+    }
+    const __m256d q = _mm256_set1_pd(quarter);
+    for (; k + 4 <= ke; k += 4) {
+        if (pf_vi && (k & 7) < 4) __builtin_prefetch(pf_vi + k, 0, 3);
+        __m256d sum = _mm256_add_pd(_mm256_loadu_pd(a + k), _mm256_loadu_pd(b + k));
+        sum = _mm256_add_pd(sum, _mm256_loadu_pd(l + k));
+        sum = _mm256_add_pd(sum, _mm256_loadu_pd(r + k));
+        _mm256_stream_pd(out + k, _mm256_mul_pd(sum, q));
+    }
+    sum4_segment(a, b, l, r, out, k, ke, quarter);
+#elif defined(__SSE2__)
+    int k = kb;
+    if (k < ke && (reinterpret_cast<std::uintptr_t>(out + k) & 15) != 0) {
+        out[k] = (a[k] + b[k] + l[k] + r[k]) * quarter;
+        ++k;
+    }
+    const __m128d q = _mm_set1_pd(quarter);
+    for (; k + 2 <= ke; k += 2) {
+        if (pf_vi && (k & 7) < 2) __builtin_prefetch(pf_vi + k, 0, 3);
+        __m128d sum = _mm_add_pd(_mm_loadu_pd(a + k), _mm_loadu_pd(b + k));
+        sum = _mm_add_pd(sum, _mm_loadu_pd(l + k));
+        sum = _mm_add_pd(sum, _mm_loadu_pd(r + k));
+        _mm_stream_pd(out + k, _mm_mul_pd(sum, q));
+    }
+    sum4_segment(a, b, l, r, out, k, ke, quarter);
+#else
+    (void)pf_vi;
+    sum4_segment(a, b, l, r, out, kb, ke, quarter);
+#endif
+}
+
+// Interior five-point update for cells [kb, ke) of one row segment; c[kb-1] and c[ke] must be valid.
+static inline void update_segment(const double* up, const double* c, const double* dn, double* out,
+                                  int kb, int ke, double quarter) {
+    sum4_segment(dn, up, c - 1, c + 1, out, kb, ke, quarter);
+}
+
+static inline void update_segment_pf(const double* up, const double* c, const double* dn, double* out,
+                                     int kb, int ke, double quarter, const double* pf_vi, double* pf_vr) {
+    sum4_segment_pf(dn, up, c - 1, c + 1, out, kb, ke, quarter, pf_vi, pf_vr);
+}
+
+static inline void update_segment_nt(const double* up, const double* c, const double* dn, double* out,
+                                     int kb, int ke, double quarter, const double* pf_vi = nullptr) {
+    sum4_segment_nt(dn, up, c - 1, c + 1, out, kb, ke, quarter, pf_vi);
+}
+
+// Orders the streaming stores before later loads/stores (needed before another thread reads the data).
+static inline void stream_fence() {
+#if defined(__SSE2__)
+    _mm_sfence();
+#endif
+}
+
+// Picks a prefetch distance for --prefetch=auto by timing run(distance) (one idempotent interior update) for a few
+// candidates, best of three each; distance 0 (no software prefetch) is always a candidate.
+template <class Run>
+int tune_prefetch_distance(Run run, std::ostream& log) {
+    static const int candidates[] = {0, 1, 2, 4, 8, 16};
+    int best = 0;
+    double best_s = 0.0;
+    log << "[prefetch] autotune";
+    for (int distance : candidates) {
+        double s = 0.0;
+        for (int rep = 0; rep < 3; ++rep) {
+            auto t0 = std::chrono::steady_clock::now();
+            run(distance);
+            const double rep_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            s = rep == 0 ? rep_s : std::min(s, rep_s);
+        }
+        log << " d" << distance << "=" << s * 1e3 << "ms";
+        if (distance == 0 || s < best_s) {
+            best = distance;
+            best_s = s;
+        }
+    }
+    log << " -> " << best << "\n";
+    return best;
+}
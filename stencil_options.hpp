@@ -0,0 +1,261 @@
+/*
+High-Performance C++: Shared command-line handling for the stencil engines
+Purpose: Keep the original positional form `nx ny nt` working everywhere and add optional `--name=value` flags
+         for the tuning knobs introduced by the optimized engines.
+*/
+#pragma once
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include "stencil_grid.hpp"
+
+struct StencilOptions {
+    int nx = 10000; //grid size (x)
+    int ny = 200;   //grid size (y)
+    int nt = 200;   //num of time steps
+
+    // Row padding in cache lines: -1 = automatic (odd number of lines per row), -2 = off (stride == ny, as before)
+    int pad_lines = -1;
+
+    GridLayout layout = GridLayout::RowMajor; // element order: row, tiled or morton
+    int tile = 64;                            // tile edge for the tiled/morton layouts
+    bool quiet = false;                       // skip the per-step console progress output
+
+    // Non-temporal stores for vr in the update: auto = when both fields exceed the last-level cache;
+    // compare = auto for the run, then time the update with and without them
+    enum class NtStores { Auto, On, Off, Compare } nt_stores = NtStores::Auto;
+
+    // Software prefetch distance in rows beyond the row being read (1 = row i+2 while updating row i);
+    // 0 = off, -1 = pick by timing a few candidate distances before the run
+    int prefetch = 0;
+
+    int threads = 0; // parallel engines: worker count, 0 = all hardware threads
+
+    // Store the grid transposed (ny rows of nx) so the long axis is contiguous; row layout only.
+    // auto = when nx is at least kTransposeRatio times ny
+    enum class Transpose { Auto, On, Off } transpose = Transpose::Auto;
+
+    // How the grid's pages are faulted in before the first step: on first write during initialisation (none),
+    // by the kernel at allocation (populate, MAP_POPULATE) or by all worker threads in parallel (parallel)
+    enum class Prefault { None, Populate, Parallel } prefault = Prefault::None;
+
+    FieldLayout fields = FieldLayout::Separate; // vi/vr as two arrays or interleaved in SIMD-width blocks
+
+    // Print a roofline table (roofline.hpp) after the run; a non-empty roofline_csv also writes it as CSV
+    bool roofline = false;
+    std::string roofline_csv;
+
+    bool perf = false; // hardware counters per phase via perf_event_open (perf_counters.hpp)
+
+    std::string dump_grid; // write the final vi here after the run (grid_dump.hpp); empty = no dump
+    std::string trace;     // Chrome trace JSON of the per-thread phase spans (trace_export.hpp); empty = none
+    std::string latency_hist; // per-step latency percentiles as .hgrm text (step_latency.hpp); empty = none
+};
+
+inline const char* prefault_name(StencilOptions::Prefault mode) {
+    switch (mode) {
+    case StencilOptions::Prefault::Populate: return "populate";
+    case StencilOptions::Prefault::Parallel: return "parallel";
+    default: return "none";
+    }
+}
+
+constexpr int kTransposeRatio = 8;
+
+inline bool use_transposed_storage(const StencilOptions& opt) {
+    if (opt.layout != GridLayout::RowMajor || opt.transpose == StencilOptions::Transpose::Off) return false;
+    return opt.transpose == StencilOptions::Transpose::On ||
+           static_cast<long long>(opt.nx) >= static_cast<long long>(kTransposeRatio) * opt.ny;
+}
+
+// Shared flags an engine acts on (bit mask for supports_stencil_flags); --pad with a line count, --layout other
+// than row, --fields=interleaved, --transpose=on, --nt-stores=on|compare, --prefetch other than 0, --threads above 1,
+// --prefault other than none, and the presence of --roofline, --perf, --trace or --latency-hist.
+enum StencilFlag : unsigned {
+    kFlagPad = 1u << 0,
+    kFlagLayout = 1u << 1,
+    kFlagFields = 1u << 2,
+    kFlagTranspose = 1u << 3,
+    kFlagNtStores = 1u << 4,
+    kFlagPrefetch = 1u << 5,
+    kFlagThreads = 1u << 6,
+    kFlagPrefault = 1u << 7,
+    kFlagRoofline = 1u << 8,
+    kFlagPerf = 1u << 9,
+    kFlagTrace = 1u << 10,
+    kFlagLatencyHist = 1u << 11,
+    kAllStencilFlags = (1u << 12) - 1,
+};
+
+// Prints a message and returns false when a flag asks an engine for something it does not do. Values that describe
+// what every engine does anyway (--pad=auto|off, --transpose=auto|off, --nt-stores=auto|off, --fields=separate, ...)
+// pass, so the tools can hand the same flag set to every engine.
+inline bool supports_stencil_flags(const StencilOptions& opt, unsigned supported, const char* engine) {
+    const struct {
+        unsigned flag;
+        bool requested;
+        const char* text;
+    } checks[] = {
+        {kFlagPad, opt.pad_lines >= 0, "--pad=<lines>"},
+        {kFlagLayout, opt.layout != GridLayout::RowMajor, "--layout other than row"},
+        {kFlagFields, opt.fields != FieldLayout::Separate, "--fields=interleaved"},
+        {kFlagTranspose, opt.transpose == StencilOptions::Transpose::On, "--transpose=on"},
+        {kFlagNtStores, opt.nt_stores == StencilOptions::NtStores::On ||
+                            opt.nt_stores == StencilOptions::NtStores::Compare, "--nt-stores=on|compare"},
+        {kFlagPrefetch, opt.prefetch != 0, "--prefetch"},
+        {kFlagThreads, opt.threads > 1, "--threads"},
+        {kFlagPrefault, opt.prefault != StencilOptions::Prefault::None, "--prefault"},
+        {kFlagRoofline, opt.roofline, "--roofline"},
+        {kFlagPerf, opt.perf, "--perf"},
+        {kFlagTrace, !opt.trace.empty(), "--trace"},
+        {kFlagLatencyHist, !opt.latency_hist.empty(), "--latency-hist"},
+    };
+    bool ok = true;
+    for (const auto& c : checks) {
+        if (c.requested && !(supported & c.flag)) {
+            std::cerr << engine << " does not support " << c.text << ".\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Returns the text after "--name=" when arg matches, nullptr otherwise.
+inline const char* stencil_flag_value(const char* arg, const char* name) {
+    const size_t len = std::strlen(name);
+    if (std::strncmp(arg, "--", 2) != 0 || std::strncmp(arg + 2, name, len) != 0 || arg[2 + len] != '=') return nullptr;
+    return arg + 3 + len;
+}
+
+// Whole decimal number in [lo, hi] (strtoll with an end check: no trailing text, no silent 0 for "abc").
+inline bool parse_stencil_int(const char* text, long long lo, long long hi, long long& value) {
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoll(text, &end, 10);
+    return end != text && *end == '\0' && errno == 0 && value >= lo && value <= hi;
+}
+
+// Parses `nx ny nt` (positional, optional) followed or preceded by flags. Prints a message and returns false on bad input.
+// Engine-specific flags go through `extra`: it returns true when it consumed the argument.
+inline bool parse_stencil_options(int argc, char* argv[], StencilOptions& opt,
+                                  const std::function<bool(const char*)>& extra = nullptr) {
+    long long positional[3];
+    int npos = 0;
+    for (int a = 1; a < argc; ++a) {
+        const char* arg = argv[a];
+        const char* v = nullptr;
+        if ((v = stencil_flag_value(arg, "pad"))) {
+            if (std::strcmp(v, "auto") == 0) opt.pad_lines = -1;
+            else if (std::strcmp(v, "off") == 0) opt.pad_lines = -2;
+            else {
+                long long lines = 0;
+                if (!parse_stencil_int(v, 0, 1024, lines)) {
+                    std::cerr << "Invalid --pad value: " << v << " (expected auto, off or 0..1024 cache lines)\n";
+                    return false;
+                }
+                opt.pad_lines = static_cast<int>(lines);
+            }
+        } else if ((v = stencil_flag_value(arg, "layout"))) {
+            if (!parse_layout(v, opt.layout)) {
+                std::cerr << "Unknown layout: " << v << " (expected row, tiled or morton)\n";
+                return false;
+            }
+        } else if ((v = stencil_flag_value(arg, "tile"))) {
+            long long tile = 0;
+            if (!parse_stencil_int(v, 1, INT_MAX, tile)) {
+                std::cerr << "Invalid --tile value: " << v << " (expected a tile edge >= 1)\n";
+                return false;
+            }
+            opt.tile = static_cast<int>(tile);
+        } else if ((v = stencil_flag_value(arg, "nt-stores"))) {
+            if (std::strcmp(v, "auto") == 0) opt.nt_stores = StencilOptions::NtStores::Auto;
+            else if (std::strcmp(v, "on") == 0) opt.nt_stores = StencilOptions::NtStores::On;
+            else if (std::strcmp(v, "off") == 0) opt.nt_stores = StencilOptions::NtStores::Off;
+            else if (std::strcmp(v, "compare") == 0) opt.nt_stores = StencilOptions::NtStores::Compare;
+            else {
+                std::cerr << "Unknown --nt-stores value: " << v << " (expected auto, on, off or compare)\n";
+                return false;
+            }
+        } else if ((v = stencil_flag_value(arg, "prefetch"))) {
+            long long rows = -1;
+            if (std::strcmp(v, "auto") != 0 && !parse_stencil_int(v, 0, INT_MAX, rows)) {
+                std::cerr << "Invalid --prefetch value: " << v << " (expected auto or a distance >= 0 in rows)\n";
+                return false;
+            }
+            opt.prefetch = static_cast<int>(rows);
+        } else if ((v = stencil_flag_value(arg, "threads"))) {
+            long long threads = 0;
+            if (!parse_stencil_int(v, 0, INT_MAX, threads)) {
+                std::cerr << "Invalid --threads value: " << v << " (expected 0 for all hardware threads or a count)\n";
+                return false;
+            }
+            opt.threads = static_cast<int>(threads);
+        } else if ((v = stencil_flag_value(arg, "transpose"))) {
+            if (std::strcmp(v, "auto") == 0) opt.transpose = StencilOptions::Transpose::Auto;
+            else if (std::strcmp(v, "on") == 0) opt.transpose = StencilOptions::Transpose::On;
+            else if (std::strcmp(v, "off") == 0) opt.transpose = StencilOptions::Transpose::Off;
+            else {
+                std::cerr << "Unknown --transpose value: " << v << " (expected auto, on or off)\n";
+                return false;
+            }
+        } else if ((v = stencil_flag_value(arg, "prefault"))) {
+            if (std::strcmp(v, "none") == 0) opt.prefault = StencilOptions::Prefault::None;
+            else if (std::strcmp(v, "populate") == 0) opt.prefault = StencilOptions::Prefault::Populate;
+            else if (std::strcmp(v, "parallel") == 0) opt.prefault = StencilOptions::Prefault::Parallel;
+            else {
+                std::cerr << "Unknown --prefault value: " << v << " (expected none, populate or parallel)\n";
+                return false;
+            }
+        } else if ((v = stencil_flag_value(arg, "fields"))) {
+            if (!parse_field_layout(v, opt.fields)) {
+                std::cerr << "Unknown --fields value: " << v << " (expected separate or interleaved)\n";
+                return false;
+            }
+        } else if (std::strcmp(arg, "--roofline") == 0) {
+            opt.roofline = true;
+        } else if ((v = stencil_flag_value(arg, "roofline"))) {
+            opt.roofline = true;
+            opt.roofline_csv = v;
+        } else if (std::strcmp(arg, "--perf") == 0) {
+            opt.perf = true;
+        } else if ((v = stencil_flag_value(arg, "dump-grid"))) {
+            opt.dump_grid = v;
+        } else if ((v = stencil_flag_value(arg, "trace"))) {
+            opt.trace = v;
+        } else if ((v = stencil_flag_value(arg, "latency-hist"))) {
+            opt.latency_hist = v;
+        } else if (std::strcmp(arg, "--quiet") == 0) {
+            opt.quiet = true;
+        } else if (extra && extra(arg)) {
+            continue;
+        } else if (std::strncmp(arg, "--", 2) == 0) {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return false;
+        } else if (npos < 3) {
+            // each extent must fit an int; the cell count nx * ny is always formed in 64-bit arithmetic
+            if (!parse_stencil_int(arg, 0, INT_MAX, positional[npos++])) {
+                std::cerr << "Invalid grid extent: " << arg << " (expected an integer 0.." << INT_MAX << ")\n";
+                return false;
+            }
+        }
+    }
+    if (npos == 3) {
+        opt.nx = static_cast<int>(positional[0]);
+        opt.ny = static_cast<int>(positional[1]);
+        opt.nt = static_cast<int>(positional[2]);
+    }
+    if (opt.transpose == StencilOptions::Transpose::On && opt.layout != GridLayout::RowMajor) {
+        std::cerr << "--transpose=on needs --layout=row.\n";
+        return false;
+    }
+    if (opt.nx < 1 || opt.ny < 1 || opt.nt < 0) {
+        std::cerr << "Invalid grid size: nx=" << opt.nx << " ny=" << opt.ny << " nt=" << opt.nt << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,139 @@
+/*
+High-Performance C++: Per-step arenas for transient buffers
+Purpose: Everything an engine builds during one timestep and throws away at its end (hit records, scratch) is carved
+         out of a monotonic arena that is reset at the step boundary, so the timestep loop itself never touches the
+         global heap.
+Key ideas: Each arena owns one block and hands it to a std::pmr::monotonic_buffer_resource. A step that outgrows the
+           block continues in overflow chunks, and the next reset() enlarges the block so the same load does not
+           overflow again. Block and chunks come from the global operator new, so alloc_counter.hpp counts them:
+           overflow chunks land in the step that needed them and show up in its steady-state count (a warning), while
+           engines call reset() before StepAllocStats::begin_step(), so the growth that follows a first-step overflow
+           is not charged to the steady state; "[arena] growths=" reports it. Arenas are cache-line aligned so
+           per-thread arenas do not share lines. Blocks and chunks are charged to the output
+           subsystem of memory_report.hpp.
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <ostream>
+#include <vector>
+#include "memory_report.hpp"
+#include "usdt_probes.hpp"
+
+class alignas(64) StepArena {
+public:
+    explicit StepArena(std::size_t initial_bytes = 64 * 1024)
+        : block_bytes_(initial_bytes), block_(allocate_block(initial_bytes)) {
+        mono_.emplace(block_, block_bytes_, &overflow_);
+    }
+    ~StepArena() {
+        mono_.reset();
+        ::operator delete(block_, kBlockAlign);
+    }
+    StepArena(const StepArena&) = delete;
+    StepArena& operator=(const StepArena&) = delete;
+
+    std::pmr::memory_resource* resource() { return &*mono_; }
+
+    // Drops everything allocated since the last reset; containers using the arena must be gone by now.
+    void reset() {
+        const std::size_t overflow = overflow_.bytes;
+        mono_.reset(); // returns the overflow chunks
+        overflow_.bytes = 0;
+        if (overflow > 0) {
+            ::operator delete(block_, kBlockAlign);
+            block_ = nullptr;
+            block_bytes_ = 2 * (block_bytes_ + overflow);
+            block_ = allocate_block(block_bytes_);
+            ++growths_;
+        }
+        mono_.emplace(block_, block_bytes_, &overflow_);
+    }
+
+    std::size_t block_bytes() const { return block_bytes_; }
+    std::size_t growths() const { return growths_; }
+    std::size_t overflow_chunks() const { return overflow_.chunks; }
+
+private:
+    static constexpr std::align_val_t kBlockAlign{64};
+
+    static std::byte* allocate_block(std::size_t bytes) {
+        MemoryScope scope(kMemOutput);
+        return static_cast<std::byte*>(::operator new(bytes, kBlockAlign));
+    }
+
+    // Upstream of the monotonic resource: only reached when a step outgrows the block.
+    struct OverflowResource : std::pmr::memory_resource {
+        std::size_t bytes = 0, chunks = 0;
+
+        void* do_allocate(std::size_t n, std::size_t align) override {
+            MemoryScope scope(kMemOutput);
+            void* p = ::operator new(n, std::align_val_t(align));
+            bytes += n;
+            ++chunks;
+            return p;
+        }
+        void do_deallocate(void* p, std::size_t, std::size_t align) override {
+            ::operator delete(p, std::align_val_t(align));
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    };
+
+    std::size_t block_bytes_;
+    std::byte* block_;
+    std::size_t growths_ = 0;
+    OverflowResource overflow_;
+    std::optional<std::pmr::monotonic_buffer_resource> mono_;
+};
+
+// A vector of per-step records backed by its own arena; reset() empties both at the step boundary.
+template <class T>
+class StepBuffer {
+public:
+    explicit StepBuffer(std::size_t initial_bytes = 64 * 1024) : arena_(initial_bytes) {
+        items_.emplace(arena_.resource());
+    }
+
+    std::pmr::vector<T>& items() { return *items_; }
+    const std::pmr::vector<T>& items() const { return *items_; }
+
+    void reset() {
+        items_.reset();
+        arena_.reset();
+        items_.emplace(arena_.resource());
+    }
+
+    const StepArena& arena() const { return arena_; }
+
+private:
+    StepArena arena_;
+    std::optional<std::pmr::vector<T>> items_;
+};
+
+// One threshold hit (|vi| and |vr| already taken); buffered per step, written in (t, i, j) order afterwards.
+struct StencilHit {
+    std::int64_t i, j;
+    double vi, vr;
+};
+
+inline void write_hits(std::ostream& out, int t, const std::pmr::vector<StencilHit>& hits) {
+    STENCIL_PROBE2(hits_written, t, hits.size());
+    for (const StencilHit& h : hits) out << t << " " << h.i << " " << h.j << " " << h.vi << " " << h.vr << "\n";
+}
+
+// "[arena] ..." summary over a set of step buffers (block sizes after growth, growth events, overflow chunks).
+template <class T>
+void report_step_buffers(std::ostream& out, const StepBuffer<T>* buffers, int count) {
+    std::size_t bytes = 0, growths = 0, chunks = 0;
+    for (int b = 0; b < count; ++b) {
+        bytes += buffers[b].arena().block_bytes();
+        growths += buffers[b].arena().growths();
+        chunks += buffers[b].arena().overflow_chunks();
+    }
+    out << "[arena] buffers=" << count << " block_bytes=" << bytes << " growths=" << growths
+        << " overflow_chunks=" << chunks << "\n";
+}
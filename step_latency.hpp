@@ -0,0 +1,245 @@
+/*
+High-Performance C++: Per-timestep latency distribution
+Purpose: Interactive use needs every step to be fast, not the average: a flush, a burst of page faults or a noisy
+         neighbour shows up as a few slow steps that a mean time hides. Record the wall time of every step and
+         report its distribution (p50, p90, p99, p99.9, max) and the slowest steps with the phase that made them slow.
+Key ideas: Step times go into an HDR histogram (log-linear buckets with a fixed relative precision, here 2 significant
+           digits over 1 .. 2^44 TSC ticks), allocated once before the loop, so recording is an index computation and
+           an increment; ticks are converted to ns only when reporting. The TSC calibration (a ~10 ms spin) is forced
+           in the constructor, so construct the StepLatency before the run's timer starts. The K slowest steps are
+           kept in a fixed array together with the per-phase ticks of that step (differences of the PhaseTimer
+           totals), and each is annotated with the phase that exceeded its mean per-step time the most; time outside
+           the timed phases (console output, buffer resets) is reported as "untimed".
+Notes: --latency-hist=path writes the percentile distribution in the text format of HdrHistogram's
+       outputPercentileDistribution (.hgrm), which the usual HdrHistogram plotters read.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "phase_timer.hpp"
+
+// Log-linear histogram of non-negative integers (HdrHistogram layout): values below 2 * half_count are exact; above
+// that every power-of-two bucket has half_count sub-buckets, so the relative error stays under 1 / half_count.
+class HdrHistogram {
+public:
+    explicit HdrHistogram(int significant_digits = 2, int max_bits = 40) : max_bits_(max_bits) {
+        const double largest_exact = 2.0 * std::pow(10.0, significant_digits);
+        sub_magnitude_ = static_cast<int>(std::ceil(std::log2(largest_exact)));
+        half_magnitude_ = sub_magnitude_ - 1;
+        half_count_ = std::uint64_t(1) << half_magnitude_;
+        sub_mask_ = (std::uint64_t(1) << sub_magnitude_) - 1;
+        const int buckets = max_bits_ - sub_magnitude_ + 1;
+        counts_.assign(static_cast<std::size_t>(buckets + 1) * half_count_, 0);
+    }
+
+    void record(std::uint64_t value) {
+        value = std::min(value, (std::uint64_t(1) << max_bits_) - 1);
+        ++counts_[index_of(value)];
+        ++total_;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+        sum_ += static_cast<double>(value);
+    }
+
+    std::uint64_t count() const { return total_; }
+    std::uint64_t max() const { return total_ ? max_ : 0; }
+    std::uint64_t min() const { return total_ ? min_ : 0; }
+    double mean() const { return total_ ? sum_ / total_ : 0.0; }
+
+    // Smallest recorded value v (to the histogram's precision) with at least `percentile` percent of values <= v.
+    std::uint64_t value_at_percentile(double percentile) const {
+        if (total_ == 0) return 0;
+        const std::uint64_t target =
+            std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(percentile / 100.0 * total_)));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= target) return std::min(highest_equivalent(i), max_);
+        }
+        return max_;
+    }
+
+    std::uint64_t count_above(std::uint64_t value) const {
+        std::uint64_t n = 0;
+        for (std::size_t i = 0; i < counts_.size(); ++i) {
+            if (counts_[i] && lowest_equivalent(i) > value) n += counts_[i];
+        }
+        return n;
+    }
+
+    // Percentile distribution as HdrHistogram's .hgrm text, values divided by `scale` (e.g. 1000 for ns -> us).
+    void write_hgrm(std::ostream& out, double scale) const {
+        out << std::setw(12) << "Value" << " " << std::setw(14) << "Percentile" << " " << std::setw(10) << "TotalCount"
+            << " " << std::setw(14) << "1/(1-Percentile)" << "\n\n";
+        std::uint64_t seen = 0;
+        out << std::fixed;
+        for (std::size_t i = 0; i < counts_.size(); ++i) {
+            if (counts_[i] == 0) continue;
+            seen += counts_[i];
+            const double fraction = static_cast<double>(seen) / total_;
+            out << std::setprecision(3) << std::setw(12) << std::min(highest_equivalent(i), max_) / scale << " "
+                << std::setprecision(12) << std::setw(14) << fraction << " " << std::setw(10) << seen << " "
+                << std::setprecision(2) << std::setw(14);
+            if (seen < total_) out << 1.0 / (1.0 - fraction) << "\n";
+            else out << "inf" << "\n";
+        }
+        out << std::setprecision(3) << "#[Mean    = " << std::setw(12) << mean() / scale << ", StdDeviation   = "
+            << std::setw(12) << stddev() / scale << "]\n";
+        out << "#[Max     = " << std::setw(12) << max() / scale << ", Total count    = " << std::setw(12) << total_
+            << "]\n";
+        out << "#[Buckets = " << std::setw(12) << counts_.size() / half_count_ - 1 << ", SubBuckets     = "
+            << std::setw(12) << 2 * half_count_ << "]\n";
+    }
+
+private:
+    std::size_t index_of(std::uint64_t value) const {
+        const int bucket = (64 - __builtin_clzll(value | sub_mask_)) - (half_magnitude_ + 1);
+        const std::uint64_t sub = value >> bucket;
+        return (static_cast<std::size_t>(bucket + 1) << half_magnitude_) + (sub - half_count_);
+    }
+    // Bucket and sub-bucket of counts_[i]; the lowest value they hold is sub << bucket, their width 1 << bucket.
+    void locate(std::size_t i, int& bucket, std::uint64_t& sub) const {
+        bucket = static_cast<int>(i >> half_magnitude_) - 1;
+        sub = (i & (half_count_ - 1)) + half_count_;
+        if (bucket < 0) {
+            sub -= half_count_;
+            bucket = 0;
+        }
+    }
+    std::uint64_t lowest_equivalent(std::size_t i) const {
+        int bucket;
+        std::uint64_t sub;
+        locate(i, bucket, sub);
+        return sub << bucket;
+    }
+    std::uint64_t highest_equivalent(std::size_t i) const {
+        int bucket;
+        std::uint64_t sub;
+        locate(i, bucket, sub);
+        return (sub << bucket) + (std::uint64_t(1) << bucket) - 1;
+    }
+    double stddev() const {
+        if (total_ == 0) return 0.0;
+        const double m = mean();
+        double squares = 0.0;
+        for (std::size_t i = 0; i < counts_.size(); ++i) {
+            if (counts_[i] == 0) continue;
+            const double mid = 0.5 * (lowest_equivalent(i) + highest_equivalent(i)) - m;
+            squares += mid * mid * counts_[i];
+        }
+        return std::sqrt(squares / total_);
+    }
+
+    int max_bits_, sub_magnitude_, half_magnitude_;
+    std::uint64_t half_count_, sub_mask_;
+    std::vector<std::uint64_t> counts_;
+    std::uint64_t total_ = 0, min_ = UINT64_MAX, max_ = 0;
+    double sum_ = 0.0;
+};
+
+// Wall time of every timestep, measured around the whole loop body, with the phase split of the slowest ones.
+class StepLatency {
+public:
+    static constexpr int kSlowest = 5;
+
+    explicit StepLatency(const PhaseTimer& timer) : timer_(timer), histogram_(2, 44) { tsc_calibration(); }
+
+    void begin_step(int step) {
+        step_ = step;
+        for (int phase = 0; phase < kPhaseCount; ++phase) {
+            phase_start_[phase] = timer_.ticks(static_cast<Phase>(phase));
+        }
+        start_ = tsc_now();
+    }
+
+    void end_step() {
+        const std::uint64_t ticks = tsc_now() - start_;
+        histogram_.record(ticks);
+        // keep the kSlowest longest steps, slowest first
+        int slot = kept_;
+        while (slot > 0 && slowest_[slot - 1].ticks < ticks) --slot;
+        if (slot >= kSlowest) return;
+        for (int k = std::min(kept_, kSlowest - 1); k > slot; --k) slowest_[k] = slowest_[k - 1];
+        SlowStep& s = slowest_[slot];
+        s.step = step_;
+        s.ticks = ticks;
+        for (int phase = 0; phase < kPhaseCount; ++phase) {
+            s.phase_ticks[phase] = timer_.ticks(static_cast<Phase>(phase)) - phase_start_[phase];
+        }
+        kept_ = std::min(kept_ + 1, kSlowest);
+    }
+
+    // "[latency] ..." lines: the distribution in microseconds, then the slowest steps above outlier_factor x p50,
+    // each with the phase that exceeded its mean per-step time the most. steps is the loop's step count.
+    void report(std::ostream& out, int steps, double outlier_factor = 2.0) const {
+        const double cal = tsc_calibration().ticks_per_ns, to_us = 1e-3 / cal;
+        const std::uint64_t p50 = histogram_.value_at_percentile(50.0); // ticks
+        const std::uint64_t outlier_ticks = static_cast<std::uint64_t>(p50 * outlier_factor);
+        out << "[latency] steps=" << histogram_.count() << " p50_us=" << p50 * to_us
+            << " p90_us=" << histogram_.value_at_percentile(90.0) * to_us
+            << " p99_us=" << histogram_.value_at_percentile(99.0) * to_us
+            << " p99.9_us=" << histogram_.value_at_percentile(99.9) * to_us << " max_us=" << histogram_.max() * to_us
+            << " mean_us=" << histogram_.mean() * to_us
+            << " jitter_p99_over_p50=" << (p50 ? static_cast<double>(histogram_.value_at_percentile(99.0)) / p50 : 0.0)
+            << " outliers=" << histogram_.count_above(outlier_ticks) << " (> " << outlier_factor << "x p50)\n";
+        // mean per-step ticks of every phase and of the untimed rest of the step
+        double mean[kPhaseCount], mean_untimed = histogram_.mean();
+        for (int phase = 0; phase < kPhaseCount; ++phase) {
+            const double total = static_cast<double>(timer_.ticks(static_cast<Phase>(phase)));
+            mean[phase] = phase == kPhaseInit ? 0.0 : total / std::max(1, steps);
+            mean_untimed -= mean[phase];
+        }
+        for (int k = 0; k < kept_; ++k) {
+            const SlowStep& s = slowest_[k];
+            if (s.ticks <= outlier_ticks) break;
+            double untimed = static_cast<double>(s.ticks);
+            for (int phase = 0; phase < kPhaseCount; ++phase) untimed -= s.phase_ticks[phase];
+            const char* blame = "untimed";
+            double excess = untimed - mean_untimed;
+            for (int phase = 0; phase < kPhaseCount; ++phase) {
+                if (s.phase_ticks[phase] > 0 && s.phase_ticks[phase] - mean[phase] > excess) {
+                    blame = phase_name(phase);
+                    excess = s.phase_ticks[phase] - mean[phase];
+                }
+            }
+            out << "[latency] outlier step=" << s.step << " us=" << s.ticks * to_us
+                << " x_p50=" << static_cast<double>(s.ticks) / std::max<std::uint64_t>(p50, 1)
+                << " slowest_phase=" << blame << " (+" << excess * to_us << " us over its mean)";
+            for (int phase = 0; phase < kPhaseCount; ++phase) {
+                if (s.phase_ticks[phase] == 0) continue;
+                out << " " << phase_name(phase) << "_us=" << s.phase_ticks[phase] / cal * 1e-3;
+            }
+            out << " untimed_us=" << std::max(0.0, untimed) / cal * 1e-3 << "\n";
+        }
+    }
+
+    bool write_hgrm(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file) return false;
+        histogram_.write_hgrm(file, 1e3 * tsc_calibration().ticks_per_ns); // ticks -> us
+        return file.good();
+    }
+
+private:
+    struct SlowStep {
+        int step = -1;
+        std::uint64_t ticks = 0;
+        std::uint64_t phase_ticks[kPhaseCount] = {};
+    };
+
+    const PhaseTimer& timer_;
+    HdrHistogram histogram_; // TSC ticks
+    std::uint64_t phase_start_[kPhaseCount] = {};
+    std::uint64_t start_ = 0;
+    int step_ = -1;
+    SlowStep slowest_[kSlowest];
+    int kept_ = 0;
+};
@@ -0,0 +1,227 @@
+/*
+High-Performance C++: STREAM-style bandwidth probe per cache level and thread count
+Purpose: Measure what the host can actually move, so the roofline report and the benchmark harness can normalise
+         against it instead of a datasheet number: copy, scale, add and triad bandwidth with the working set sized
+         for L1, L2, the last-level cache and DRAM, at each requested thread count.
+Key ideas: Every thread sweeps its own slice of three arrays. For the per-core levels (L1, L2) each thread's slice is
+           half the cache, for the LLC the whole set is half the shared cache, for DRAM it is four times the LLC
+           (capped at 1 GB). Small sets are swept many times per timing so thread start-up and timer resolution
+           vanish; the best of several timings counts. Bytes follow the STREAM convention (copy and scale 16 B per
+           element, add and triad 24 B): write-allocate traffic is not counted. traffic_gbps() adds it back for
+           comparisons with models that do count it (roofline.hpp).
+           Results are cached per host in a small text file keyed by host, CPU model, cache sizes and topology, so
+           the probe runs once per machine; a stale or missing file is re-measured.
+*/
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "machine_probe.hpp"
+#ifdef _WIN32
+#include <io.h>
+#endif
+
+// Runs work(tid) on `threads` threads (tid 0 on the caller) and returns the wall time in seconds.
+template <class Work>
+double time_on_threads(int threads, Work work) {
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> team;
+    for (int tid = 1; tid < threads; ++tid) team.emplace_back(work, tid);
+    work(0);
+    for (auto& th : team) th.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+enum StreamLevel { kLevelL1, kLevelL2, kLevelLLC, kLevelDRAM, kLevelCount };
+
+inline const char* stream_level_name(int level) {
+    static const char* const names[kLevelCount] = {"L1", "L2", "LLC", "DRAM"};
+    return names[level];
+}
+
+struct StreamRow {
+    int level = kLevelDRAM;
+    std::size_t bytes = 0; // total working set of the three arrays
+    int threads = 1;
+    double copy = 0.0, scale = 0.0, add = 0.0, triad = 0.0; // GB/s, STREAM convention
+
+    // Triad bandwidth counting the write-allocate of the destination too (32 B per element instead of 24).
+    double traffic_gbps() const { return triad * 32.0 / 24.0; }
+};
+
+struct StreamTable {
+    std::string signature;
+    std::vector<StreamRow> rows;
+
+    const StreamRow* find(int level, int threads) const {
+        for (const StreamRow& row : rows) {
+            if (row.level == level && row.threads == threads) return &row;
+        }
+        return nullptr;
+    }
+};
+
+// Cache level a working set of `bytes` lives in when spread over `threads` cores.
+inline int stream_level_for(std::size_t bytes, int threads, const CacheSizes& caches) {
+    const std::size_t per_thread = bytes / std::max(1, threads);
+    if (per_thread <= caches.l1d) return kLevelL1;
+    if (per_thread <= caches.l2) return kLevelL2;
+    if (bytes <= caches.llc) return kLevelLLC;
+    return kLevelDRAM;
+}
+
+// Identifies the machine a table was measured on; a table with another signature is stale.
+inline std::string stream_signature(const HostInfo& host, const CacheSizes& caches, const CpuTopology& topo) {
+    std::ostringstream sig;
+    sig << "host=" << host.name << " cpu=" << host.cpu << " l1d=" << caches.l1d << " l2=" << caches.l2
+        << " llc=" << caches.llc << " logical=" << topo.logical << " cores=" << topo.cores
+        << " packages=" << topo.packages;
+    return sig.str();
+}
+
+// $XDG_CACHE_HOME or ~/.cache when they exist, the working directory otherwise.
+inline bool directory_writable(const std::string& dir) {
+#if defined(__unix__) || defined(__APPLE__)
+    return access(dir.c_str(), W_OK) == 0;
+#elif defined(_WIN32)
+    return _access(dir.c_str(), 2) == 0;
+#else
+    return false;
+#endif
+}
+
+// The calibration file in the user's cache directory when it exists there or could be written there, else in the
+// working directory. Only checks: nothing is created until save_stream_table.
+inline std::string stream_cache_path(const HostInfo& host) {
+    std::string dir;
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME")) dir = xdg;
+    else if (const char* home = std::getenv("HOME")) dir = std::string(home) + "/.cache";
+    const std::string file = "stencil_stream_" + host.name + ".txt";
+    if (!dir.empty() && (std::ifstream(dir + "/" + file).good() || directory_writable(dir))) return dir + "/" + file;
+    return file;
+}
+
+inline bool load_stream_table(const std::string& path, const std::string& signature, StreamTable& table) {
+    std::ifstream in(path);
+    std::string line;
+    if (!std::getline(in, line) || line != "# " + signature) return false;
+    table.signature = signature;
+    table.rows.clear();
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#' || line.compare(0, 5, "level") == 0) continue;
+        std::istringstream fields(line);
+        std::string level_name;
+        char comma;
+        StreamRow row;
+        if (!std::getline(fields, level_name, ',') ||
+            !(fields >> row.bytes >> comma >> row.threads >> comma >> row.copy >> comma >> row.scale >> comma >>
+              row.add >> comma >> row.triad)) {
+            return false;
+        }
+        for (int level = 0; level < kLevelCount; ++level) {
+            if (level_name == stream_level_name(level)) row.level = level;
+        }
+        table.rows.push_back(row);
+    }
+    return !table.rows.empty();
+}
+
+inline bool save_stream_table(const std::string& path, const StreamTable& table) {
+    std::ofstream out(path);
+    out << "# " << table.signature << "\n";
+    out << "level,bytes,threads,copy_GBps,scale_GBps,add_GBps,triad_GBps\n";
+    for (const StreamRow& row : table.rows) {
+        out << stream_level_name(row.level) << "," << row.bytes << "," << row.threads << "," << row.copy << ","
+            << row.scale << "," << row.add << "," << row.triad << "\n";
+    }
+    return out.good();
+}
+
+// The four STREAM kernels over a working set of `bytes` (three arrays) on `threads` threads.
+inline StreamRow measure_stream(int level, std::size_t bytes, int threads) {
+    StreamRow row;
+    row.level = level;
+    row.threads = std::max(1, threads);
+    const std::size_t n = std::max<std::size_t>(bytes / (3 * sizeof(double)), 64 * row.threads);
+    row.bytes = 3 * n * sizeof(double);
+    std::vector<double> a(n, 1.0), b(n, 2.0), c(n, 0.0);
+    const double q = 3.0;
+    // sweeps per timing: at least ~256 MB of traffic so short sets are timed over many passes
+    const long sweeps = std::max(1L, static_cast<long>((std::size_t(256) << 20) / row.bytes));
+    const int timings = 4; // the first warms up (page faults, caches), the best of the rest counts
+
+    auto run = [&](int kernel) {
+        double best = 0.0;
+        for (int rep = 0; rep < timings; ++rep) {
+            const double s = time_on_threads(row.threads, [&](int tid) {
+                const std::size_t begin = n * tid / row.threads, end = n * (tid + 1) / row.threads;
+                double* __restrict pa = a.data();
+                double* __restrict pb = b.data();
+                double* __restrict pc = c.data();
+                for (long sweep = 0; sweep < sweeps; ++sweep) {
+                    switch (kernel) {
+                    case 0: for (std::size_t k = begin; k < end; ++k) pc[k] = pa[k]; break;
+                    case 1: for (std::size_t k = begin; k < end; ++k) pb[k] = q * pc[k]; break;
+                    case 2: for (std::size_t k = begin; k < end; ++k) pc[k] = pa[k] + pb[k]; break;
+                    default: for (std::size_t k = begin; k < end; ++k) pa[k] = pb[k] + q * pc[k]; break;
+                    }
+                    asm volatile("" ::: "memory"); // every sweep must really run
+                }
+            });
+            if (rep > 0 && (best == 0.0 || s < best)) best = s;
+        }
+        const double elem_bytes = kernel < 2 ? 16.0 : 24.0;
+        return elem_bytes * n * sweeps / best * 1e-9;
+    };
+    row.copy = run(0);
+    row.scale = run(1);
+    row.add = run(2);
+    row.triad = run(3);
+    return row;
+}
+
+// Working set used for `level` with `threads` threads.
+inline std::size_t stream_level_bytes(int level, int threads, const CacheSizes& caches) {
+    switch (level) {
+    case kLevelL1: return caches.l1d / 2 * threads;
+    case kLevelL2: return caches.l2 / 2 * threads;
+    case kLevelLLC: return caches.llc / 2;
+    default: return std::min(std::size_t(1) << 30, std::max(std::size_t(64) << 20, 4 * caches.llc));
+    }
+}
+
+inline StreamTable measure_stream_table(const std::string& signature, const CacheSizes& caches,
+                                        const std::vector<int>& thread_counts, std::ostream& log) {
+    StreamTable table;
+    table.signature = signature;
+    for (int threads : thread_counts) {
+        for (int level = 0; level < kLevelCount; ++level) {
+            table.rows.push_back(measure_stream(level, stream_level_bytes(level, threads, caches), threads));
+            const StreamRow& row = table.rows.back();
+            log << "[stream] level=" << stream_level_name(level) << " bytes=" << row.bytes << " threads=" << threads
+                << " copy_GBps=" << row.copy << " scale_GBps=" << row.scale << " add_GBps=" << row.add
+                << " triad_GBps=" << row.triad << "\n";
+        }
+    }
+    return table;
+}
+
+// The cached table for this host, or nullptr when there is none (or it is stale); never measures.
+inline const StreamTable* cached_stream_table() {
+    static StreamTable table;
+    static const bool loaded = [] {
+        const HostInfo host = describe_host();
+        return load_stream_table(stream_cache_path(host),
+                                 stream_signature(host, detect_cache_sizes(), detect_topology()), table);
+    }();
+    return loaded ? &table : nullptr;
+}
@@ -0,0 +1,95 @@
+/*
+High-Performance C++: Chrome trace export of the phase span rings
+Purpose: Turn the per-thread span rings of phase_timer.hpp into a timeline (--trace=path.json) that chrome://tracing
+         and ui.perfetto.dev open directly: one track per thread, one box per phase and timestep, so load imbalance,
+         barrier stalls and I/O interference can be seen instead of inferred from one elapsed time.
+Key ideas: Every span becomes a Chrome "complete" event (ph "X") with its timestep as an argument; timestamps are the
+           TSC converted to microseconds since the earliest span. Waits are recorded where the engine knows them
+           (e.g. the out-of-core engine waiting for its I/O threads). Barrier waits of a fork-join phase are derived:
+           a worker's span ends when its share is done, the coordinating thread's span of the same phase and step
+           ends when the last worker is done, and the gap between the two is the time that worker sat at the
+           barrier or join. It is emitted as a "wait" event on the worker's track.
+Notes: Rings keep the latest spans only (kTraceRingCapacity per thread with --trace), so very long runs show their
+       tail. The export runs after the timestep loop and writes straight to the file; it allocates nothing itself.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include "phase_timer.hpp"
+
+struct TraceTrack {
+    const char* name;          // thread name shown in the viewer
+    int index;                 // printed after the name (worker number), -1 for none
+    const PhaseRing* ring;
+    const PhaseRing* joined_by = nullptr; // the coordinating thread's ring: derive barrier waits against it
+};
+
+// Calls wait(begin, end, step, phase) for every span of `ring` that ends before the span of the same phase and step
+// in `coordinator` (which covers the whole fork-join region). Both rings are in time order.
+template <class Wait>
+void for_each_barrier_wait(const PhaseRing& ring, const PhaseRing& coordinator, Wait wait) {
+    std::size_t c = 0;
+    for (std::size_t k = 0; k < ring.size(); ++k) {
+        const PhaseSpan& span = ring[k];
+        // the enclosing coordinator span is the first one that ends at or after this span
+        while (c < coordinator.size() && coordinator[c].end < span.end) ++c;
+        if (c == coordinator.size()) return;
+        const PhaseSpan& region = coordinator[c];
+        if (region.phase == span.phase && region.step == span.step && region.begin <= span.begin &&
+            region.end > span.end) {
+            wait(span.end, region.end, span.step, span.phase);
+        }
+    }
+}
+
+inline bool write_chrome_trace(const std::string& path, const char* engine, const TraceTrack* tracks, int count) {
+    std::ofstream out(path);
+    if (!out) return false;
+    const TscCalibration& cal = tsc_calibration();
+    std::uint64_t origin = UINT64_MAX;
+    for (int t = 0; t < count; ++t) {
+        if (tracks[t].ring->size() > 0) origin = std::min(origin, (*tracks[t].ring)[0].begin);
+    }
+    if (origin == UINT64_MAX) origin = 0;
+    auto us = [&](std::uint64_t ticks) { return static_cast<double>(ticks - origin) / cal.ticks_per_ns * 1e-3; };
+    bool first = true;
+    auto event = [&](int tid, int phase, int step, std::uint64_t begin, std::uint64_t end) {
+        out << (first ? "\n" : ",\n") << "{\"name\":\"" << phase_name(phase) << "\",\"cat\":\""
+            << (phase == kPhaseWait ? "wait" : phase == kPhaseRead || phase == kPhaseWrite ? "io" : "phase")
+            << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << us(begin)
+            << ",\"dur\":" << static_cast<double>(end - begin) / cal.ticks_per_ns * 1e-3
+            << ",\"args\":{\"step\":" << step << "}}";
+        first = false;
+    };
+
+    out.precision(15);
+    out << "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"engine\":\"" << engine << "\",\"clock\":\""
+        << (cal.tsc ? "rdtscp" : "steady_clock") << "\"},\"traceEvents\":[";
+    out << "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"" << engine << "\"}}";
+    first = false;
+    for (int t = 0; t < count; ++t) {
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t << ",\"args\":{\"name\":\""
+            << tracks[t].name;
+        if (tracks[t].index >= 0) out << " " << tracks[t].index;
+        out << "\"}},\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t
+            << ",\"args\":{\"sort_index\":" << t << "}}";
+    }
+    for (int t = 0; t < count; ++t) {
+        const PhaseRing& ring = *tracks[t].ring;
+        for (std::size_t k = 0; k < ring.size(); ++k) {
+            event(t, ring[k].phase, ring[k].step, ring[k].begin, ring[k].end);
+        }
+        if (tracks[t].joined_by) {
+            auto wait = [&](std::uint64_t begin, std::uint64_t end, int step, int) {
+                event(t, kPhaseWait, step, begin, end);
+            };
+            for_each_barrier_wait(ring, *tracks[t].joined_by, wait);
+        }
+    }
+    out << "\n]}\n";
+    return out.good();
+}
@@ -0,0 +1,38 @@
+/*
+High-Performance C++: USDT static tracepoints
+Purpose: Let bpftrace, perf or SystemTap attach to a running engine at the timestep loop (step begin/end, phase
+         boundaries per thread, output writes, grid file I/O and checkpoints) instead of rebuilding with printf timing.
+Key ideas: With <sys/sdt.h> (systemtap-sdt-dev / systemtap-sdt-devel) every STENCIL_PROBE is a single nop in the
+           code plus a note in the ELF section .note.stapsdt that tells a tracer where the nop is and where its
+           arguments live; a tracer turns the nop into a breakpoint only while it is attached. Without the header
+           the macros expand to nothing and their arguments are not evaluated.
+           Provider "stencil"; probes and arguments (thread -1 is the main or coordinating thread):
+             step_begin(t)                          step_end(t)
+             pass_begin(t, steps)                   pass_end(t, steps)             out-of-core passes of tblock steps
+             phase_begin(t, phase, thread)          phase_end(t, phase, thread)    phase numbers of phase_timer.hpp
+             hits_written(t, count)                                                 one output batch (write_hits)
+             io_read(t, first_row, bytes)           io_write(t, first_row, bytes)  out-of-core grid file
+             io_flush(t, total_bytes)                                               grid file flushed after a pass
+             checkpoint_begin(nx, ny)               checkpoint_end(bytes)          --dump-grid
+Notes: List the probes with `readelf -n <exe> | grep -A3 stapsdt`, e.g.
+       bpftrace -e 'usdt:./cache_optimized.exe:stencil:step_end { @[arg0 % 10] = count(); }'.
+       Define STENCIL_NO_USDT to compile them out even where the header exists.
+*/
+#pragma once
+
+#if defined(__has_include) && !defined(STENCIL_NO_USDT)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define STENCIL_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef STENCIL_HAVE_USDT
+#define STENCIL_PROBE1(name, a) DTRACE_PROBE1(stencil, name, a)
+#define STENCIL_PROBE2(name, a, b) DTRACE_PROBE2(stencil, name, a, b)
+#define STENCIL_PROBE3(name, a, b, c) DTRACE_PROBE3(stencil, name, a, b, c)
+#else
+#define STENCIL_PROBE1(name, a) static_cast<void>(0)
+#define STENCIL_PROBE2(name, a, b) static_cast<void>(0)
+#define STENCIL_PROBE3(name, a, b, c) static_cast<void>(0)
+#endif
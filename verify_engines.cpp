@@ -0,0 +1,330 @@
+/*
+High-Performance C++: Cross-engine correctness verification
+Purpose: Check that an engine computes what another one (normally serial_baseline) computes, on many grid shapes
+         including the degenerate ones (nx or ny of 1 to 3) where boundary handling is easy to get wrong: the final
+         grid cell by cell and the threshold output record by record.
+Key ideas: Both engines run as separate processes on the same shape with --dump-grid (grid_dump.hpp), and their
+           data_out files are kept. Grids are compared by the largest difference in units in the last place (ULP) and
+           the largest absolute difference; hit records by key (t, i, j) and value.
+           Two equality modes: bitwise (every cell and every record identical; for engines that only reorder work and
+           must produce the same bits) and tolerance (cells within --ulp ULPs, or within --abs plus --rel times the
+           larger magnitude; for lossy or differently-rounded engines). Hit values are printed with six significant
+           digits, so tolerance mode also accepts differences within that precision, and a record present on one side
+           only is accepted when its |vr| - |vi| lies within the tolerance of the 1e-2 threshold (the cell may
+           legitimately flip).
+           Hits are compared sorted by (t, i, j) by default, since tiled layouts emit them tile by tile;
+           --hit-order=strict also checks the order.
+Notes: Shapes are the fixed edge cases, a list given with --shapes, and --random more drawn from --seed. Engines run
+       in the working directory (they write data_out there), so runs are sequential; intermediate files are named
+       verify_a.* and verify_b.* and removed unless --keep is given. Exit status 1 when any shape fails.
+*/
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "bench_engines.hpp"
+#include "grid_dump.hpp"
+#include "stencil_options.hpp"
+
+using namespace std;
+
+struct Shape {
+    long long nx, ny;
+    int nt;
+};
+
+struct Side {
+    const Engine* engine;
+    string flags;
+    string tag; // "a" or "b": file names verify_<tag>.grid / .hits / .log
+};
+
+struct Tolerance {
+    bool bitwise = true;
+    uint64_t ulp = 4;
+    double abs = 0.0, rel = 0.0; // |a - b| <= abs + rel * max(|a|, |b|) also passes
+};
+
+struct HitRecord {
+    long long t, i, j;
+    double vi, vr;
+    string text;
+};
+
+// Runs one engine on a shape; false (with the reason) if it failed or left no output.
+static bool run_engine(const Side& side, const Shape& shape, string& error) {
+    const string grid = "verify_" + side.tag + ".grid", hits = "verify_" + side.tag + ".hits";
+    const string log = "verify_" + side.tag + ".log";
+    remove(grid.c_str());
+    remove("data_out");
+    string cmd = string(kExePrefix) + side.engine->exe + " " + to_string(shape.nx) + " " + to_string(shape.ny) + " " +
+                 to_string(shape.nt) + " --quiet --dump-grid=" + grid;
+    if (!side.flags.empty()) cmd += " " + side.flags;
+    cmd += " > " + log + " 2>&1";
+    const int status = system(cmd.c_str());
+    if (status != 0) {
+        error = side.engine->name + string(" exited with status ") + to_string(status) + " (see " + log + ")";
+        return false;
+    }
+    remove(hits.c_str());
+    if (rename("data_out", hits.c_str()) != 0) {
+        error = side.engine->name + string(" wrote no data_out");
+        return false;
+    }
+    return true;
+}
+
+// Distance between two doubles in representable values (0 for identical bits, huge across signs or for NaN).
+static uint64_t ulp_distance(double a, double b) {
+    if (isnan(a) || isnan(b)) return memcmp(&a, &b, sizeof a) == 0 ? 0 : UINT64_MAX;
+    int64_t ia, ib;
+    memcpy(&ia, &a, sizeof a);
+    memcpy(&ib, &b, sizeof b);
+    // map the sign-magnitude bit patterns onto a monotonic integer line
+    if (ia < 0) ia = INT64_MIN - ia;
+    if (ib < 0) ib = INT64_MIN - ib;
+    return ia > ib ? static_cast<uint64_t>(ia) - static_cast<uint64_t>(ib)
+                   : static_cast<uint64_t>(ib) - static_cast<uint64_t>(ia);
+}
+
+static bool values_match(double a, double b, const Tolerance& tol) {
+    if (tol.bitwise) return memcmp(&a, &b, sizeof a) == 0;
+    return ulp_distance(a, b) <= tol.ulp || fabs(a - b) <= tol.abs + tol.rel * max(fabs(a), fabs(b));
+}
+
+// "grid ok max_ulp=.. max_abs=.." or the first mismatching cell; returns false on a mismatch.
+static bool compare_grids(const GridDump& a, const GridDump& b, const Tolerance& tol, ostream& report) {
+    if (a.nx != b.nx || a.ny != b.ny) {
+        report << "grid shape " << a.nx << "x" << a.ny << " vs " << b.nx << "x" << b.ny;
+        return false;
+    }
+    uint64_t max_ulp = 0;
+    double max_abs = 0.0;
+    long long bad = 0, first = -1;
+    for (size_t k = 0; k < a.values.size(); ++k) {
+        const double x = a.values[k], y = b.values[k];
+        max_ulp = max(max_ulp, ulp_distance(x, y));
+        if (!isnan(x) && !isnan(y)) max_abs = max(max_abs, fabs(x - y));
+        if (!values_match(x, y, tol)) {
+            if (first < 0) first = static_cast<long long>(k);
+            ++bad;
+        }
+    }
+    report << "grid max_ulp=";
+    if (max_ulp == UINT64_MAX) report << "nan";
+    else report << max_ulp;
+    report << " max_abs=" << max_abs;
+    if (bad > 0) {
+        report << " cells_off=" << bad << " first=(" << first / a.ny << "," << first % a.ny << ") "
+               << setprecision(17) << a.values[first] << " vs " << b.values[first] << setprecision(6);
+    }
+    return bad == 0;
+}
+
+static bool read_hits(const string& path, vector<HitRecord>& hits) {
+    ifstream in(path);
+    if (!in) return false;
+    for (string line; getline(in, line);) {
+        if (line.empty()) continue; // serial_baseline starts every record with a newline
+        HitRecord h;
+        istringstream fields(line);
+        if (!(fields >> h.t >> h.i >> h.j >> h.vi >> h.vr)) return false;
+        h.text = line;
+        hits.push_back(h);
+    }
+    return true;
+}
+
+static bool key_less(const HitRecord& x, const HitRecord& y) {
+    if (x.t != y.t) return x.t < y.t;
+    return x.i != y.i ? x.i < y.i : x.j < y.j;
+}
+
+// Printed hit values carry six significant digits; tolerance mode accepts differences within that rounding.
+static bool hit_values_match(double a, double b, const Tolerance& tol) {
+    if (tol.bitwise) return a == b;
+    return values_match(a, b, tol) || fabs(a - b) <= 1e-5 * max(fabs(a), fabs(b));
+}
+
+// A record on one side only is a legitimate threshold flip when its margin is within the tolerance.
+static bool may_flip(const HitRecord& h, const Tolerance& tol) {
+    if (tol.bitwise) return false;
+    const double margin = 1e-2 - fabs(fabs(h.vr) - fabs(h.vi)); // distance below the threshold
+    return margin <= 2.0 * tol.abs + (2.0 * tol.rel + 1e-5) * max(fabs(h.vi), fabs(h.vr));
+}
+
+static bool compare_hits(vector<HitRecord>& a, vector<HitRecord>& b, bool strict_order, const Tolerance& tol,
+                         ostream& report) {
+    report << " hits=" << a.size() << "/" << b.size();
+    if (strict_order && tol.bitwise) {
+        for (size_t k = 0; k < min(a.size(), b.size()); ++k) {
+            if (a[k].text != b[k].text) {
+                report << " record " << k << ": \"" << a[k].text << "\" vs \"" << b[k].text << "\"";
+                return false;
+            }
+        }
+        if (a.size() != b.size()) {
+            report << " (counts differ)";
+            return false;
+        }
+        return true;
+    }
+    if (!strict_order) {
+        stable_sort(a.begin(), a.end(), key_less);
+        stable_sort(b.begin(), b.end(), key_less);
+    }
+    size_t ka = 0, kb = 0, flips = 0, bad = 0;
+    string first;
+    auto note = [&](const string& what) {
+        if (bad++ == 0) first = what;
+    };
+    while (ka < a.size() || kb < b.size()) {
+        if (kb == b.size() || (ka < a.size() && key_less(a[ka], b[kb]))) {
+            if (may_flip(a[ka], tol)) ++flips;
+            else note("only in a: \"" + a[ka].text + "\"");
+            ++ka;
+        } else if (ka == a.size() || key_less(b[kb], a[ka])) {
+            if (may_flip(b[kb], tol)) ++flips;
+            else note("only in b: \"" + b[kb].text + "\"");
+            ++kb;
+        } else {
+            const bool same = tol.bitwise ? a[ka].text == b[kb].text
+                                          : hit_values_match(a[ka].vi, b[kb].vi, tol) &&
+                                                hit_values_match(a[ka].vr, b[kb].vr, tol);
+            if (!same) note("\"" + a[ka].text + "\" vs \"" + b[kb].text + "\"");
+            ++ka;
+            ++kb;
+        }
+    }
+    if (flips > 0) report << " threshold_flips=" << flips;
+    if (bad > 0) report << " records_off=" << bad << " first: " << first;
+    return bad == 0;
+}
+
+int main(int argc, char* argv[]) {
+    // CLI: [--engines=serial,optimized] [--mode=bitwise|tolerance] [--ulp=4] [--abs=0] [--rel=0]
+    //      [--shapes=NXxNYxNT,...]
+    //      [--random=8] [--seed=1] [--flags-a="..."] [--flags-b="..."] [--hit-order=sorted|strict] [--keep]
+    string engines_arg = "serial,optimized", shapes_arg;
+    Side a{nullptr, "", "a"}, b{nullptr, "", "b"};
+    Tolerance tol;
+    int random_shapes = 8;
+    unsigned seed = 1;
+    bool strict_order = false, keep = false;
+    for (int k = 1; k < argc; ++k) {
+        const char* arg = argv[k];
+        const char* v = nullptr;
+        if ((v = stencil_flag_value(arg, "engines"))) engines_arg = v;
+        else if ((v = stencil_flag_value(arg, "mode"))) {
+            if (strcmp(v, "bitwise") == 0) tol.bitwise = true;
+            else if (strcmp(v, "tolerance") == 0) tol.bitwise = false;
+            else {
+                cerr << "--mode must be bitwise or tolerance.\n";
+                return 1;
+            }
+        }
+        else if ((v = stencil_flag_value(arg, "ulp"))) tol.ulp = strtoull(v, nullptr, 10);
+        else if ((v = stencil_flag_value(arg, "abs"))) tol.abs = atof(v);
+        else if ((v = stencil_flag_value(arg, "rel"))) tol.rel = atof(v);
+        else if ((v = stencil_flag_value(arg, "shapes"))) shapes_arg = v;
+        else if ((v = stencil_flag_value(arg, "random"))) random_shapes = atoi(v);
+        else if ((v = stencil_flag_value(arg, "seed"))) seed = static_cast<unsigned>(strtoul(v, nullptr, 10));
+        else if ((v = stencil_flag_value(arg, "flags-a"))) a.flags = v;
+        else if ((v = stencil_flag_value(arg, "flags-b"))) b.flags = v;
+        else if ((v = stencil_flag_value(arg, "hit-order"))) strict_order = strcmp(v, "strict") == 0;
+        else if (strcmp(arg, "--keep") == 0) keep = true;
+        else {
+            cerr << "Unknown argument: " << arg << "\n";
+            return 1;
+        }
+    }
+    const vector<string> names = split_list(engines_arg, ',');
+    if (names.size() != 2 || !(a.engine = find_engine(names[0])) || !(b.engine = find_engine(names[1]))) {
+        cerr << "--engines takes two of serial, optimized, inplace, out_of_core, compressed, threads, openmp.\n";
+        return 1;
+    }
+    for (const Side* side : {&a, &b}) {
+        if (!file_exists(side->engine->exe)) {
+            cerr << side->engine->exe << " is not built.\n";
+            return 1;
+        }
+    }
+
+    // edge cases first: every combination of 1..3 rows/columns, then thin strips and small squares
+    vector<Shape> shapes;
+    for (long long nx = 1; nx <= 3; ++nx) {
+        for (long long ny = 1; ny <= 3; ++ny) shapes.push_back({nx, ny, 3});
+    }
+    for (long long n : {1, 2, 3}) {
+        shapes.push_back({n, 67, 4});
+        shapes.push_back({67, n, 4});
+    }
+    shapes.push_back({4, 4, 5});
+    shapes.push_back({5, 130, 4});
+    shapes.push_back({130, 5, 4});
+    for (const string& text : split_list(shapes_arg, ',')) {
+        const vector<string> dims = split_list(text, 'x');
+        Shape shape{0, 0, -1};
+        if (dims.size() == 3) shape = {atoll(dims[0].c_str()), atoll(dims[1].c_str()), atoi(dims[2].c_str())};
+        if (shape.nx < 1 || shape.ny < 1 || shape.nt < 0) {
+            cerr << "Bad shape: " << text << " (expected NXxNYxNT)\n";
+            return 1;
+        }
+        shapes.push_back(shape);
+    }
+    mt19937 rng(seed);
+    uniform_int_distribution<int> extent(1, 300), steps(1, 8);
+    for (int r = 0; r < random_shapes; ++r) {
+        const long long nx = extent(rng), ny = extent(rng);
+        shapes.push_back({nx, ny, steps(rng)});
+    }
+
+    cout << "[verify] a=" << a.engine->name << (a.flags.empty() ? "" : " " + a.flags) << " b=" << b.engine->name
+         << (b.flags.empty() ? "" : " " + b.flags) << " mode=" << (tol.bitwise ? "bitwise" : "tolerance");
+    if (!tol.bitwise) cout << " ulp=" << tol.ulp << " abs=" << tol.abs << " rel=" << tol.rel;
+    cout << " hit_order=" << (strict_order ? "strict" : "sorted") << " shapes=" << shapes.size() << "\n";
+
+    int failures = 0;
+    for (const Shape& shape : shapes) {
+        const string shape_text = to_string(shape.nx) + "x" + to_string(shape.ny) + "x" + to_string(shape.nt);
+        ostringstream report;
+        string error;
+        bool ok = run_engine(a, shape, error) && run_engine(b, shape, error);
+        if (!ok) {
+            report << error;
+        } else {
+            GridDump ga, gb;
+            vector<HitRecord> ha, hb;
+            if (!read_grid_dump("verify_a.grid", ga) || !read_grid_dump("verify_b.grid", gb)) {
+                ok = false;
+                report << "missing or malformed grid dump";
+            } else if (!read_hits("verify_a.hits", ha) || !read_hits("verify_b.hits", hb)) {
+                ok = false;
+                report << "malformed hit record";
+            } else {
+                const bool grid_ok = compare_grids(ga, gb, tol, report);
+                const bool hits_ok = compare_hits(ha, hb, strict_order, tol, report);
+                ok = grid_ok && hits_ok;
+            }
+        }
+        cout << (ok ? "OK   " : "FAIL ") << left << setw(14) << shape_text << right << " " << report.str() << "\n";
+        cout.flush();
+        if (!ok) ++failures;
+    }
+    if (!keep) {
+        for (const char* tag : {"a", "b"}) {
+            for (const char* ext : {".grid", ".hits", ".log"}) remove(("verify_" + string(tag) + ext).c_str());
+        }
+    }
+    cout << "[verify] " << shapes.size() - failures << "/" << shapes.size() << " shapes passed\n";
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+/*
+High-Performance C++: Persistent worker threads for the std::thread code paths
+Purpose: Start the threads once per run instead of once per timestep. Creating a std::thread costs a heap allocation
+         and a kernel call; a pool only waits on a condition variable between dispatches.
+Usage: pool.run(task) calls task(tid) on every worker (tid = 0 .. size()-1) and returns when all have finished;
+       start(task) + wait() does the same without blocking in between (used for read-ahead / write-behind).
+       The task is passed by reference and must stay alive until the dispatch has finished.
+*/
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool {
+public:
+    explicit WorkerPool(int threads) {
+        workers_.reserve(threads);
+        for (int tid = 0; tid < threads; ++tid) workers_.emplace_back([this, tid]() { loop(tid); });
+    }
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& th : workers_) th.join();
+    }
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int size() const { return static_cast<int>(workers_.size()); }
+
+    template <class Task>
+    void start(Task& task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            call_ = [](void* ctx, int tid) { (*static_cast<Task*>(ctx))(tid); };
+            ctx_ = &task;
+            pending_ = size();
+            ++generation_;
+        }
+        wake_.notify_all();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]() { return pending_ == 0; });
+    }
+
+    template <class Task>
+    void run(Task& task) {
+        start(task);
+        wait();
+    }
+
+private:
+    void loop(int tid) {
+        std::uint64_t seen = 0;
+        for (;;) {
+            void (*call)(void*, int);
+            void* ctx;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&]() { return stop_ || generation_ != seen; });
+                if (stop_) return;
+                seen = generation_;
+                call = call_;
+                ctx = ctx_;
+            }
+            call(ctx, tid);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0) done_.notify_all();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_, done_;
+    void (*call_)(void*, int) = nullptr;
+    void* ctx_ = nullptr;
+    int pending_ = 0;
+    std::uint64_t generation_ = 0;
+    bool stop_ = false;
+};